@@ -0,0 +1,402 @@
+// Microbenchmarks and end-to-end load generation for logwindow.
+//
+// Build and run with ./run_bench.fish, or by hand:
+//   clang++ -std=c++20 -O3 -o logwindow_bench bench.cc && ./logwindow_bench
+//
+// Pass a substring to run only the matching benchmarks, e.g.
+//   ./logwindow_bench pipe
+
+#define LOGWINDOW_NO_MAIN
+#include "main.cc"
+
+#include <cstdio>
+#include <iomanip>
+#include <random>
+
+// ============================================================================
+// Allocation counting
+// ============================================================================
+
+static std::atomic<uint64_t> g_allocations{0};
+
+// GCC flags free() on memory from the replaced operator new below, which is
+// exactly how a replacement pair is supposed to work
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void *operator new(size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+// ============================================================================
+// Input generation
+// ============================================================================
+
+struct Distribution {
+  const char *name;
+  size_t minLength;
+  size_t maxLength;
+  bool crlf; // Every tenth line ends in "\r\n"
+};
+
+static const Distribution kDistributions[] = {
+    {"short", 16, 16, false},
+    {"medium", 80, 80, false},
+    {"long", 400, 400, false},
+    {"mixed", 1, 400, true},
+};
+
+// About `bytes` of newline-terminated lines drawn from `dist`
+std::string generateInput(const Distribution &dist, size_t bytes) {
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<size_t> length(dist.minLength, dist.maxLength);
+  std::string out;
+  out.reserve(bytes + dist.maxLength + 2);
+  for (size_t line = 0; out.size() < bytes; ++line) {
+    size_t len = length(rng);
+    size_t start = out.size();
+    out.resize(start + len, 'x');
+    std::memcpy(&out[start], "line ", std::min<size_t>(len, 5));
+    if (dist.crlf && line % 10 == 0) {
+      out += '\r';
+    }
+    out += '\n';
+  }
+  return out;
+}
+
+std::vector<std::string_view> splitLines(const std::string &input) {
+  std::vector<std::string_view> lines;
+  size_t pos = 0;
+  while (pos < input.size()) {
+    size_t nl = input.find('\n', pos);
+    lines.emplace_back(input.data() + pos, nl - pos);
+    pos = nl + 1;
+  }
+  return lines;
+}
+
+// ============================================================================
+// Reporting
+// ============================================================================
+
+struct Result {
+  double seconds = 0;
+  uint64_t bytes = 0;
+  uint64_t lines = 0;
+  uint64_t allocations = 0;
+  bool hasFlushes = false;
+  uint64_t flushes = 0;
+  uint64_t flushP50Us = 0;
+  uint64_t flushP99Us = 0;
+};
+
+void printHeader() {
+  std::cout << std::left << std::setw(34) << "benchmark" << std::right
+            << std::setw(10) << "MB/s" << std::setw(12) << "Mlines/s"
+            << std::setw(13) << "allocs/line" << std::setw(9) << "flushes"
+            << std::setw(20) << "flush p50/p99 us" << '\n';
+}
+
+void printResult(const std::string &name, const Result &r) {
+  double mb = static_cast<double>(r.bytes) / 1e6;
+  double mlines = static_cast<double>(r.lines) / 1e6;
+  std::cout << std::left << std::setw(34) << name << std::right << std::fixed
+            << std::setprecision(1) << std::setw(10) << mb / r.seconds
+            << std::setprecision(2) << std::setw(12) << mlines / r.seconds
+            << std::setprecision(4) << std::setw(13)
+            << (r.lines ? static_cast<double>(r.allocations) /
+                              static_cast<double>(r.lines)
+                        : 0.0);
+  if (r.hasFlushes) {
+    std::cout << std::setw(9) << r.flushes << std::setw(20)
+              << (std::to_string(r.flushP50Us) + "/" +
+                  std::to_string(r.flushP99Us));
+  }
+  std::cout << std::endl;
+}
+
+// Repeats `pass` (which returns the bytes and lines it processed) until at
+// least `minSeconds` have been spent in it
+template <typename Pass>
+Result measure(Pass pass, double minSeconds = 0.3) {
+  Result r;
+  uint64_t allocationsBefore = g_allocations.load(std::memory_order_relaxed);
+  auto start = std::chrono::steady_clock::now();
+  do {
+    auto [bytes, lines] = pass();
+    r.bytes += bytes;
+    r.lines += lines;
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                              start)
+                    .count();
+  } while (r.seconds < minSeconds);
+  r.allocations =
+      g_allocations.load(std::memory_order_relaxed) - allocationsBefore;
+  return r;
+}
+
+// ============================================================================
+// LineBuffer
+// ============================================================================
+
+constexpr size_t kWindow = 1000 * 1000;
+
+void benchAppendLine(const Distribution &dist) {
+  std::string input = generateInput(dist, 8 * kWindow);
+  std::vector<std::string_view> lines = splitLines(input);
+  LineBuffer buffer(kWindow);
+  Result r = measure([&]() {
+    for (std::string_view line : lines) {
+      buffer.appendLine(line);
+    }
+    return std::pair<uint64_t, uint64_t>(input.size(), lines.size());
+  });
+  printResult(std::string("LineBuffer::appendLine/") + dist.name, r);
+}
+
+// Only the trims are timed: each pass refills the window untimed, then
+// evicts down to a quarter of it. Refilling dominates, so the run is capped
+// at a second of wall time.
+void benchTrimToMax(const Distribution &dist) {
+  std::string input = generateInput(dist, kWindow);
+  std::vector<std::string_view> lines = splitLines(input);
+  LineBuffer buffer(2 * kWindow);
+  Result r;
+  uint64_t allocations = 0;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+  while (r.seconds < 0.3 && std::chrono::steady_clock::now() < deadline) {
+    for (std::string_view line : lines) {
+      buffer.appendLine(line);
+    }
+    size_t bytesBefore = buffer.size();
+    size_t linesBefore = buffer.lineCount();
+    uint64_t allocationsBefore = g_allocations.load(std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+    buffer.trimToMax(kWindow / 4);
+    r.seconds += std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+    allocations += g_allocations.load(std::memory_order_relaxed) -
+                   allocationsBefore;
+    r.bytes += bytesBefore - buffer.size();
+    r.lines += linesBefore - buffer.lineCount();
+  }
+  r.allocations = allocations;
+  printResult(std::string("LineBuffer::trimToMax/") + dist.name, r);
+}
+
+void benchAssemble(const Distribution &dist) {
+  std::string input = generateInput(dist, 2 * kWindow);
+  LineBuffer buffer(kWindow);
+  for (std::string_view line : splitLines(input)) {
+    buffer.appendLine(line);
+  }
+  std::string out;
+  Result r = measure([&]() {
+    buffer.assemble(out);
+    return std::pair<uint64_t, uint64_t>(out.size(), buffer.lineCount());
+  });
+  printResult(std::string("LineBuffer::assemble/") + dist.name, r);
+}
+
+// ============================================================================
+// Token estimate (--max-tokens), counted once per line entering the window
+// ============================================================================
+
+void benchEstimateTokens(const Distribution &dist) {
+  std::string input = generateInput(dist, 8 * kWindow);
+  std::vector<std::string_view> lines = splitLines(input);
+  size_t tokens = 0;
+  Result r = measure([&]() {
+    for (std::string_view line : lines) {
+      tokens += estimateTokens(line);
+    }
+    return std::pair<uint64_t, uint64_t>(input.size(), lines.size());
+  });
+  if (tokens == 0) {
+    std::printf("(no tokens)\n"); // Keeps the loop from being optimized out
+  }
+  printResult(std::string("estimateTokens/") + dist.name, r);
+}
+
+// ============================================================================
+// Line splitting (LineSplitter::consume, i.e. processChunk + hand-off)
+// ============================================================================
+
+#if POSIX_AVAILABLE
+
+std::string benchDir() {
+  static std::string dir = [] {
+    char tmpl[] = "/tmp/logwindow_bench.XXXXXX";
+    const char *made = mkdtemp(tmpl);
+    return std::string(made ? made : "/tmp");
+  }();
+  return dir;
+}
+
+// Splits 64 KiB chunks, as delivered by read(), into a writer whose thread
+// drains the queue; the long interval keeps flushes out of the measurement
+void benchSplit(const Distribution &dist) {
+  std::string input = generateInput(dist, 16 * kWindow);
+  uint64_t lineCount = splitLines(input).size();
+
+  Config config;
+  config.logFile = benchDir() + "/split.log";
+  config.maxSize = kWindow;
+  config.writeInterval = std::chrono::milliseconds(60000);
+  WriterPool pool(1);
+  Writer &writer = pool.add(config);
+  pool.start();
+
+  LineSplitter splitter(writer, config.maxSize);
+  constexpr size_t kChunk = 64 * 1024;
+  Result r = measure([&]() {
+    for (size_t pos = 0; pos < input.size(); pos += kChunk) {
+      splitter.consume(input.data() + pos,
+                       std::min(kChunk, input.size() - pos));
+    }
+    return std::pair<uint64_t, uint64_t>(input.size(), lineCount);
+  });
+  pool.shutdown();
+  printResult(std::string("LineSplitter::consume/") + dist.name, r);
+}
+
+// ============================================================================
+// End to end: a producer thread writes into stdin's pipe; the real reader,
+// queue, writer thread and flushes run to EOF
+// ============================================================================
+
+void benchPipe(const char *mode, const Distribution &dist) {
+  std::string input = generateInput(dist, 64 * kWindow);
+  uint64_t lineCount = splitLines(input).size();
+
+  Config config;
+  config.logFile = benchDir() + "/pipe.log";
+  config.maxSize = 10 * 1000;
+  config.writeInterval = std::chrono::milliseconds(100);
+  if (std::strcmp(mode, "atomic") == 0) {
+    config.atomicWrites = true;
+  } else if (std::strcmp(mode, "immediate") == 0) {
+    config.immediate = true;
+  } else if (std::strcmp(mode, "parallel") == 0) {
+    config.parseThreads = 4;
+  }
+
+  int fds[2];
+  if (pipe(fds) != 0) {
+    std::cerr << "pipe() failed: " << std::strerror(errno) << '\n';
+    return;
+  }
+  int savedStdin = dup(STDIN_FILENO);
+  dup2(fds[0], STDIN_FILENO);
+  close(fds[0]);
+
+  uint64_t allocationsBefore = g_allocations.load(std::memory_order_relaxed);
+  auto start = std::chrono::steady_clock::now();
+  std::thread producer([&]() {
+    const char *data = input.data();
+    size_t left = input.size();
+    while (left > 0) {
+      ssize_t n = write(fds[1], data, left);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        break;
+      }
+      data += n;
+      left -= static_cast<size_t>(n);
+    }
+    close(fds[1]);
+  });
+
+  Result r;
+  {
+    WriterPool pool(1);
+    Writer &writer = pool.add(config);
+    pool.start();
+    {
+      PosixInputReader reader(config.maxSize);
+      reader.addStdin(writer, config.parseThreads);
+      reader.readLoop();
+    }
+    pool.shutdown();
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                              start)
+                    .count();
+    const StreamStats &stats = writer.stats();
+    r.hasFlushes = true;
+    r.flushes = stats.writer.flushes.get();
+    r.flushP50Us = stats.flushQuantileUs(0.50);
+    r.flushP99Us = stats.flushQuantileUs(0.99);
+  }
+  producer.join();
+  r.allocations =
+      g_allocations.load(std::memory_order_relaxed) - allocationsBefore;
+  r.bytes = input.size();
+  r.lines = lineCount;
+
+  dup2(savedStdin, STDIN_FILENO);
+  close(savedStdin);
+  printResult(std::string("pipe/") + mode + "/" + dist.name, r);
+}
+
+#endif // POSIX_AVAILABLE
+
+// ============================================================================
+// Main
+// ============================================================================
+
+int main(int argc, char *argv[]) {
+  std::string filter = argc > 1 ? argv[1] : "";
+  auto selected = [&](const std::string &name) {
+    return filter.empty() || name.find(filter) != std::string::npos;
+  };
+
+  printHeader();
+  for (const Distribution &dist : kDistributions) {
+    if (selected(std::string("LineBuffer::appendLine/") + dist.name)) {
+      benchAppendLine(dist);
+    }
+  }
+  for (const Distribution &dist : kDistributions) {
+    if (selected(std::string("LineBuffer::trimToMax/") + dist.name)) {
+      benchTrimToMax(dist);
+    }
+  }
+  for (const Distribution &dist : kDistributions) {
+    if (selected(std::string("LineBuffer::assemble/") + dist.name)) {
+      benchAssemble(dist);
+    }
+  }
+  for (const Distribution &dist : kDistributions) {
+    if (selected(std::string("estimateTokens/") + dist.name)) {
+      benchEstimateTokens(dist);
+    }
+  }
+#if POSIX_AVAILABLE
+  for (const Distribution &dist : kDistributions) {
+    if (selected(std::string("LineSplitter::consume/") + dist.name)) {
+      benchSplit(dist);
+    }
+  }
+  for (const char *mode : {"in-place", "atomic", "immediate", "parallel"}) {
+    for (const Distribution &dist : kDistributions) {
+      if (selected(std::string("pipe/") + mode + "/" + dist.name)) {
+        benchPipe(mode, dist);
+      }
+    }
+  }
+  std::filesystem::remove_all(benchDir());
+#endif
+  return 0;
+}
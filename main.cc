@@ -1,59 +1,485 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <cerrno>
+#include <charconv>
 #include <chrono>
 #include <condition_variable>
 #include <csignal>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <deque>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <memory>
 #include <mutex>
+#include <new>
+#include <regex>
+#include <span>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <vector>
 
 // POSIX-specific headers for signal handling and poll
 #ifdef __unix__
 #include <fcntl.h>
+#ifdef __linux__
+#include <linux/falloc.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#include <netinet/in.h>
 #include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <unistd.h>
 #define POSIX_AVAILABLE 1
 #else
 #define POSIX_AVAILABLE 0
 #endif
 
+// Linux io_uring, driven through raw syscalls (no liburing dependency)
+#if POSIX_AVAILABLE && defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define IOURING_AVAILABLE 1
+#else
+#define IOURING_AVAILABLE 0
+#endif
+
+// Optional zstd codec for --compress; build with -DLOGWINDOW_WITH_ZSTD -lzstd
+#if LOGWINDOW_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+// Byte classification for --max-tokens, 16 bytes at a time (all x86-64)
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define SSE2_AVAILABLE 1
+#else
+#define SSE2_AVAILABLE 0
+#endif
+
+// Linux event loop: edge-triggered epoll, with signals delivered by signalfd
+#if POSIX_AVAILABLE && defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#define EPOLL_AVAILABLE 1
+#else
+#define EPOLL_AVAILABLE 0
+#endif
+
+// ============================================================================
+// Timestamper: Coarse wall clock and per-chunk line prefixes (--timestamps)
+// ============================================================================
+
+// Wall-clock microseconds since the Unix epoch from the cheapest clock
+// available. CLOCK_REALTIME_COARSE is read from the vDSO without touching
+// the TSC and is only as fine as the kernel tick (1-4 ms), which is plenty
+// for stamping whole reads.
+int64_t coarseMicros() {
+#if defined(__linux__) && defined(CLOCK_REALTIME_COARSE)
+  struct timespec ts;
+  if (::clock_gettime(CLOCK_REALTIME_COARSE, &ts) == 0) {
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+  }
+#endif
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+// Formats "YYYY-MM-DDTHH:MM:SS.mmmZ " for the current time. Called once per
+// read(), never per line: every line of a chunk shares the stamp, and the
+// date part is only reformatted when the second changes.
+class Timestamper {
+public:
+  static constexpr size_t kWidth = 25; // Including the trailing space
+
+  std::string_view stamp() {
+    int64_t us = coarseMicros();
+    int64_t seconds = us / 1000000;
+    if (seconds != seconds_) {
+      seconds_ = seconds;
+      formatSeconds(seconds);
+    }
+    int millis = static_cast<int>(us / 1000 % 1000);
+    text_[20] = static_cast<char>('0' + millis / 100);
+    text_[21] = static_cast<char>('0' + millis / 10 % 10);
+    text_[22] = static_cast<char>('0' + millis % 10);
+    return {text_, kWidth};
+  }
+
+private:
+  void formatSeconds(int64_t seconds) {
+    using namespace std::chrono;
+    sys_seconds tp{std::chrono::seconds(seconds)};
+    sys_days day = floor<days>(tp);
+    year_month_day date{day};
+    hh_mm_ss<std::chrono::seconds> time{tp - day};
+    auto put = [this](size_t at, unsigned value, size_t digits) {
+      for (size_t i = digits; i-- > 0; value /= 10) {
+        text_[at + i] = static_cast<char>('0' + value % 10);
+      }
+    };
+    put(0, static_cast<unsigned>(static_cast<int>(date.year())), 4);
+    put(5, static_cast<unsigned>(date.month()), 2);
+    put(8, static_cast<unsigned>(date.day()), 2);
+    put(11, static_cast<unsigned>(time.hours().count()), 2);
+    put(14, static_cast<unsigned>(time.minutes().count()), 2);
+    put(17, static_cast<unsigned>(time.seconds().count()), 2);
+  }
+
+  int64_t seconds_ = -1;
+  char text_[kWidth + 1] = "0000-00-00T00:00:00.000Z ";
+};
+
+// ============================================================================
+// Token estimate: Approximate LLM token count of a line (--max-tokens)
+// ============================================================================
+//
+// BPE vocabularies turn a common word into about one token, split digit
+// runs into groups of up to three, and give most punctuation a token of its
+// own; a space is folded into the word after it. The estimate charges each
+// byte a weight in twelfths of a token by class, plus a start cost where a
+// letter or digit run begins. With SSE2, 16 bytes are classified per step by
+// compares against the same bytes shifted by one; elsewhere one table lookup
+// per byte gives the identical count.
+
+// --max-size defaults to this many bytes per --max-tokens token
+constexpr size_t kMaxBytesPerToken = 8;
+
+enum TokenClass : uint8_t { kSpace, kLetter, kDigit, kPunct, kHigh };
+
+constexpr std::array<uint8_t, 256> kTokenClass = [] {
+  std::array<uint8_t, 256> table{};
+  for (int c = 0; c < 256; ++c) {
+    if (c >= 0x80) {
+      table[c] = kHigh;
+    } else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') {
+      table[c] = kLetter;
+    } else if (c >= '0' && c <= '9') {
+      table[c] = kDigit;
+    } else if (c == ' ' || c == '\t') {
+      table[c] = kSpace;
+    } else {
+      table[c] = kPunct;
+    }
+  }
+  return table;
+}();
+
+// Twelfths of a token per byte, and per run of a class
+constexpr uint8_t kTokenWeight[] = {0, 1, 4, 12, 6};
+constexpr uint8_t kTokenRunStart[] = {0, 12, 8, 0, 0};
+
+#if SSE2_AVAILABLE
+// Twelfths of a token in the 16 bytes of `cur`, as two 64-bit partial sums.
+// `prev` holds the byte before each of them.
+inline __m128i tokenTwelfths(__m128i cur, __m128i prev) {
+  auto inRange = [](__m128i v, char low, char count) {
+    __m128i x = _mm_sub_epi8(v, _mm_set1_epi8(low));
+    return _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(count - 1)), x);
+  };
+  auto isLetter = [&](__m128i v) {
+    return _mm_or_si128(inRange(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 26),
+                        _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+  };
+  __m128i letter = isLetter(cur);
+  __m128i digit = inRange(cur, '0', 10);
+  __m128i high = _mm_cmplt_epi8(cur, _mm_setzero_si128());
+  __m128i space = _mm_or_si128(_mm_cmpeq_epi8(cur, _mm_set1_epi8(' ')),
+                               _mm_cmpeq_epi8(cur, _mm_set1_epi8('\t')));
+  __m128i classified =
+      _mm_or_si128(_mm_or_si128(letter, digit), _mm_or_si128(high, space));
+  __m128i letterStart = _mm_andnot_si128(isLetter(prev), letter);
+  __m128i digitStart = _mm_andnot_si128(inRange(prev, '0', 10), digit);
+
+  auto charge = [](__m128i mask, uint8_t twelfths) {
+    return _mm_and_si128(mask, _mm_set1_epi8(static_cast<char>(twelfths)));
+  };
+  // The classes are disjoint, so their weights combine with plain ORs
+  __m128i cost = _mm_or_si128(charge(letter, kTokenWeight[kLetter]),
+                              charge(digit, kTokenWeight[kDigit]));
+  cost = _mm_or_si128(cost, charge(high, kTokenWeight[kHigh]));
+  __m128i punct = _mm_andnot_si128(classified, _mm_set1_epi8(-1));
+  cost = _mm_or_si128(cost, charge(punct, kTokenWeight[kPunct]));
+  cost = _mm_add_epi8(cost, charge(letterStart, kTokenRunStart[kLetter]));
+  cost = _mm_add_epi8(cost, charge(digitStart, kTokenRunStart[kDigit]));
+  return _mm_sad_epu8(cost, _mm_setzero_si128());
+}
+#endif
+
+// Tokens in `line` plus its newline; always at least 1
+inline size_t estimateTokens(std::string_view line) {
+  size_t twelfths = 12; // The newline
+#if SSE2_AVAILABLE
+  const char *p = line.data();
+  size_t n = line.size();
+  auto load = [](const char *at) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(at));
+  };
+  __m128i sums = _mm_setzero_si128();
+  size_t i = 0;
+  if (n >= 16) {
+    __m128i first = load(p);
+    sums = tokenTwelfths(
+        first, _mm_or_si128(_mm_slli_si128(first, 1), _mm_cvtsi32_si128(' ')));
+    for (i = 16; i + 16 <= n; i += 16) {
+      sums = _mm_add_epi64(sums, tokenTwelfths(load(p + i), load(p + i - 1)));
+    }
+  }
+  if (i < n) {
+    // The last partial block, padded with spaces, which cost nothing
+    char tail[17];
+    std::memset(tail, ' ', sizeof(tail));
+    tail[0] = i > 0 ? p[i - 1] : ' ';
+    std::memcpy(tail + 1, p + i, n - i);
+    sums = _mm_add_epi64(sums, tokenTwelfths(load(tail + 1), load(tail)));
+  }
+  twelfths += static_cast<size_t>(_mm_cvtsi128_si32(sums)) +
+              static_cast<size_t>(_mm_cvtsi128_si32(_mm_srli_si128(sums, 8)));
+#else
+  uint8_t prev = kSpace;
+  for (unsigned char c : line) {
+    uint8_t cls = kTokenClass[c];
+    twelfths += kTokenWeight[cls] + kTokenRunStart[cls] * (cls != prev);
+    prev = cls;
+  }
+#endif
+  return (twelfths + 6) / 12;
+}
+
 // ============================================================================
 // Configuration
 // ============================================================================
 
+enum class TrimStrategy {
+  Rewrite,  // Rewrite the whole window when compacting
+  Collapse, // Drop the head in place with FALLOC_FL_COLLAPSE_RANGE (Linux)
+};
+
+// When flushed bytes are forced to stable storage (--durability)
+enum class Durability {
+  None,     // Left to the kernel's writeback
+  Interval, // fdatasync every --sync-interval, off the flush path
+  Always,   // Each flush returns once its data is on disk (group commit)
+};
+
+// Compression of sealed window chunks (--compress)
+enum class Codec {
+  None,
+  Zstd,
+};
+
+enum class FilterKind {
+  Include,      // Keep only lines containing one of the include patterns
+  Exclude,      // Drop lines containing the pattern
+  IncludeRegex,
+  ExcludeRegex,
+  Sample,       // Keep 1 in `limit` lines containing the pattern
+  RateLimit,    // Keep at most `limit` such lines per second
+};
+
+struct FilterSpec {
+  FilterKind kind;
+  std::string pattern;
+  uint64_t limit = 0;
+};
+
+// One output window and the source that feeds it. A source of "-" is stdin;
+// anything else is opened by the input reader (FIFO, unix socket, tailed file).
+struct InputSpec {
+  std::string logFile;
+  std::string source;
+};
+
 struct Config {
   std::string logFile;
   size_t maxSize = 10000;
+  size_t maxTokens = 0; // Approximate LLM tokens in the window; 0 disables
   std::chrono::milliseconds writeInterval{1000};
   bool immediate = false;
+  size_t flushBytes = 0;                  // 0 disables the byte trigger
+  std::chrono::milliseconds flushIdle{0}; // 0 disables idle debouncing
+  std::chrono::milliseconds maxLatency{0};
+  bool adaptiveFlush = false;
   bool atomicWrites = false;
+  Durability durability = Durability::None;
+  std::chrono::milliseconds syncInterval{1000};
+  bool incremental = false;
+  size_t compactSize = 0; // 0 means 2 * maxSize
+  TrimStrategy trimStrategy = TrimStrategy::Rewrite;
+  bool mmapWindow = false;
+  bool ioUring = false;
+  std::vector<InputSpec> inputs;
+  size_t writerThreads = 1;
+  std::string statsFile;
+  std::chrono::milliseconds statsInterval{1000};
+  Codec compress = Codec::None;
+  size_t chunkSize = 1024 * 1024;
+  int compressLevel = 3;
+  bool decompress = false;
+  bool lineIndex = false;
+  bool indexTimestamps = false;
+  std::string serve; // unix:<path> or tcp:<port>; empty disables
+  bool notify = false;
+  bool resume = false; // Seed the window from the existing log file
+  std::vector<FilterSpec> filters; // In command-line order
+  bool collapseRepeats = false;
+  bool timestamps = false; // Prefix lines with their arrival time
+  size_t memoryBudget = 0; // Bytes shared by every window; 0 disables
+  size_t minWindow = 0;    // Guaranteed per window under a budget
+  size_t history = 0;      // Evicted bytes kept in segments; 0 disables
+  size_t historySegment = 0; // 0 means history / 8
+  size_t parseThreads = 1; // >1 frames stdin on a pipeline of threads
 };
 
 void printUsage(const char *progName) {
   std::cerr << "Usage: " << progName << " <logfile> [options]\n"
+            << "       " << progName
+            << " --input <logfile>=<source> [--input ...] [options]\n"
             << "Options:\n"
             << "  --max-size <size>         Maximum log size (default: 10000)\n"
             << "                            Supports suffixes: k (1000), M (1000000), G (1000000000)\n"
+            << "  --max-tokens <n>          Also keep the window within about "
+               "<n> LLM tokens\n"
+            << "                            (--max-size then defaults to 8 "
+               "bytes per token)\n"
             << "  --write-interval <ms>     Write interval in milliseconds "
                "(default: 1000)\n"
             << "  --immediate               Write immediately on every line "
                "(ignores interval)\n"
+            << "  --flush-bytes <size>      Also flush once this much new "
+               "input is pending\n"
+            << "  --flush-idle <ms>         Flush once input has been quiet "
+               "this long\n"
+            << "                            (instead of every interval)\n"
+            << "  --max-latency <ms>        Never hold a line longer than "
+               "this (default with\n"
+            << "                            --flush-idle: the write "
+               "interval)\n"
+            << "  --adaptive-flush          Back off the interval while the "
+               "window turns over\n"
+            << "                            between flushes\n"
             << "  --atomic-writes           Use atomic write-then-rename "
                "(POSIX only)\n"
+            << "  --durability <mode>       none (default), interval or "
+               "always: when flushed\n"
+            << "                            data is fdatasync'ed (POSIX "
+               "only)\n"
+            << "  --sync-interval <ms>      Sync cadence for --durability "
+               "interval (default: 1000)\n"
+            << "  --incremental             Append new lines to the file and "
+               "only rewrite it\n"
+            << "                            when it outgrows --compact-size "
+               "(POSIX only)\n"
+            << "  --compact-size <size>     File size that triggers a rewrite "
+               "in incremental\n"
+            << "                            mode (default: 2 x max-size)\n"
+            << "  --trim-strategy <name>    How incremental mode drops old "
+               "lines: rewrite\n"
+            << "                            (default) or collapse (Linux "
+               "ext4/XFS; implies\n"
+            << "                            --incremental)\n"
+            << "  --mmap                    Keep the log file mapped as a "
+               "ring buffer with a\n"
+            << "                            <logfile>.head sidecar (POSIX "
+               "only)\n"
+            << "  --io-uring                Submit each flush as one "
+               "asynchronous io_uring\n"
+            << "                            chain (Linux only)\n"
+            << "  --input <logfile>=<src>   Also window <src> into <logfile>; "
+               "repeatable. <src> is\n"
+            << "                            a FIFO (created if missing), "
+               "unix:<path> to listen\n"
+            << "                            on a socket, a regular file to "
+               "tail, or - for stdin\n"
+            << "                            (POSIX only)\n"
+            << "  --writer-threads <n>      Threads shared by all windows for "
+               "flushing\n"
+            << "                            (default: 1)\n"
+            << "  --memory-budget <size>    Total window bytes shared by all "
+               "inputs, divided by\n"
+            << "                            recent input rate (--max-size "
+               "then caps each one)\n"
+            << "  --min-window <size>       Guaranteed window per input under "
+               "--memory-budget\n"
+            << "                            (default: budget / (4 x inputs))\n"
+            << "  --parse-threads <n>       Split and filter stdin on n "
+               "threads, then commit\n"
+            << "                            lines in order (default: 1)\n"
+            << "  --compress zstd           Keep the window as compressed "
+               "chunks in\n"
+            << "                            <logfile>.chunks/; <logfile> holds "
+               "the newest lines\n"
+            << "  --chunk-size <size>       Uncompressed size of each chunk "
+               "(default: 1M)\n"
+            << "  --compress-level <n>      zstd level (default: 3)\n"
+            << "  --decompress              Write the whole window of a "
+               "--compress log to\n"
+            << "                            stdout and exit\n"
+            << "  --include <text>          Keep only lines containing <text> "
+               "(repeatable)\n"
+            << "  --exclude <text>          Drop lines containing <text> "
+               "(repeatable)\n"
+            << "  --include-regex <re>      Like --include, with an "
+               "ECMAScript regex\n"
+            << "  --exclude-regex <re>      Like --exclude, with an "
+               "ECMAScript regex\n"
+            << "  --sample <n>:<text>       Keep 1 in n lines containing "
+               "<text>\n"
+            << "  --rate-limit <n>:<text>   Keep at most n lines per second "
+               "containing <text>\n"
+            << "  --collapse-repeats        Store consecutive identical lines "
+               "once, as\n"
+            << "                            \"<line> (repeated N times)\"\n"
+            << "  --timestamps              Prefix each line with its UTC "
+               "arrival time\n"
+            << "                            (e.g. 2026-10-14T05:31:02.123Z)\n"
+            << "  --index                   Keep a binary line-offset index "
+               "in <logfile>.idx\n"
+            << "  --index-timestamps        Also record when each line "
+               "arrived (implies --index)\n"
+            << "  --history <size>          Keep up to <size> of evicted lines "
+               "in <logfile>.history/\n"
+            << "  --history-segment <size>  Size of each --history segment "
+               "file (default:\n"
+            << "                            history / 8)\n"
+            << "  --resume                  Start from the tail of an existing "
+               "<logfile> instead\n"
+            << "                            of truncating it\n"
+            << "  --notify                  Publish a flush generation and "
+               "the changed range in\n"
+            << "                            <logfile>.gen (POSIX only)\n"
+            << "  --serve <address>         Stream the live window to clients "
+               "of unix:<path>\n"
+            << "                            or tcp:<port> (loopback; POSIX "
+               "only)\n"
+            << "  --stats-file <path>       Keep JSON throughput/flush "
+               "statistics in <path>\n"
+            << "                            (SIGUSR1 prints them to stderr)\n"
+            << "  --stats-interval <ms>     How often --stats-file is "
+               "rewritten (default: 1000)\n"
             << "  --help                    Show this help message\n"
             << "\nExamples:\n"
             << "  " << progName << " app.log\n"
             << "  " << progName
             << " app.log --max-size 10k --write-interval 500\n"
             << "  " << progName << " app.log --max-size 1M --immediate\n"
-            << "  " << progName << " app.log --atomic-writes\n";
+            << "  " << progName << " app.log --atomic-writes\n"
+            << "  " << progName << " app.log --max-size 10M --incremental\n"
+            << "  " << progName
+            << " --input emu.log=/tmp/emu.fifo --input web.log=unix:/tmp/web.sock\n";
 }
 
 // Parse human-readable size (e.g., "10k", "1M", "500")
@@ -127,6 +553,7 @@ Config parseArgs(int argc, char *argv[]) {
 
   // Parse all arguments, allowing flexible ordering
   bool foundLogFile = false;
+  bool maxSizeGiven = false;
   for (int i = 1; i < argc; ++i) {
     std::string arg = argv[i];
 
@@ -137,10 +564,22 @@ Config parseArgs(int argc, char *argv[]) {
       const char *v = requireValue(i, "--max-size");
       try {
         config.maxSize = parseSize(v);
+        maxSizeGiven = true;
       } catch (const std::exception &e) {
         std::cerr << "Error: Invalid --max-size: " << e.what() << "\n";
         std::exit(1);
       }
+    } else if (arg == "--max-tokens") {
+      const char *v = requireValue(i, "--max-tokens");
+      try {
+        config.maxTokens = parseSize(v);
+        if (config.maxTokens == 0) {
+          throw std::out_of_range("must be > 0");
+        }
+      } catch (const std::exception &e) {
+        std::cerr << "Error: Invalid --max-tokens: " << e.what() << "\n";
+        std::exit(1);
+      }
     } else if (arg == "--write-interval") {
       const char *v = requireValue(i, "--write-interval");
       try {
@@ -156,8 +595,248 @@ Config parseArgs(int argc, char *argv[]) {
       }
     } else if (arg == "--immediate") {
       config.immediate = true;
+    } else if (arg == "--flush-bytes") {
+      const char *v = requireValue(i, "--flush-bytes");
+      try {
+        config.flushBytes = parseSize(v);
+      } catch (const std::exception &e) {
+        std::cerr << "Error: Invalid --flush-bytes: " << e.what() << "\n";
+        std::exit(1);
+      }
+    } else if (arg == "--flush-idle" || arg == "--max-latency") {
+      const char *v = requireValue(i, arg.c_str());
+      try {
+        long long ms = std::stoll(v);
+        if (ms <= 0) {
+          throw std::out_of_range("must be > 0");
+        }
+        (arg == "--flush-idle" ? config.flushIdle : config.maxLatency) =
+            std::chrono::milliseconds(ms);
+      } catch (...) {
+        std::cerr << "Error: Invalid " << arg << "\n";
+        std::exit(1);
+      }
+    } else if (arg == "--compress") {
+      std::string v = requireValue(i, "--compress");
+      if (v == "none") {
+        config.compress = Codec::None;
+      } else if (v == "zstd") {
+#if LOGWINDOW_WITH_ZSTD
+        config.compress = Codec::Zstd;
+#else
+        std::cerr << "Error: This build has no zstd support (rebuild with "
+                     "-DLOGWINDOW_WITH_ZSTD -lzstd)\n";
+        std::exit(1);
+#endif
+      } else {
+        std::cerr << "Error: Invalid --compress (use zstd or none)\n";
+        std::exit(1);
+      }
+    } else if (arg == "--chunk-size") {
+      const char *v = requireValue(i, "--chunk-size");
+      try {
+        config.chunkSize = parseSize(v);
+      } catch (const std::exception &e) {
+        std::cerr << "Error: Invalid --chunk-size: " << e.what() << "\n";
+        std::exit(1);
+      }
+    } else if (arg == "--compress-level") {
+      const char *v = requireValue(i, "--compress-level");
+      try {
+        config.compressLevel = std::stoi(v);
+      } catch (...) {
+        std::cerr << "Error: Invalid --compress-level\n";
+        std::exit(1);
+      }
+    } else if (arg == "--decompress") {
+      config.decompress = true;
+    } else if (arg == "--stats-file") {
+      config.statsFile = requireValue(i, "--stats-file");
+    } else if (arg == "--stats-interval") {
+      const char *v = requireValue(i, "--stats-interval");
+      try {
+        long long ms = std::stoll(v);
+        if (ms <= 0) {
+          throw std::out_of_range("must be > 0");
+        }
+        config.statsInterval = std::chrono::milliseconds(ms);
+      } catch (...) {
+        std::cerr << "Error: Invalid --stats-interval\n";
+        std::exit(1);
+      }
+    } else if (arg == "--durability") {
+      std::string v = requireValue(i, "--durability");
+      if (v == "none") {
+        config.durability = Durability::None;
+      } else if (v == "interval") {
+        config.durability = Durability::Interval;
+      } else if (v == "always") {
+        config.durability = Durability::Always;
+      } else {
+        std::cerr << "Error: Invalid --durability (use none, interval or "
+                     "always)\n";
+        std::exit(1);
+      }
+    } else if (arg == "--sync-interval") {
+      const char *v = requireValue(i, "--sync-interval");
+      try {
+        long long ms = std::stoll(v);
+        if (ms <= 0) {
+          throw std::out_of_range("must be > 0");
+        }
+        config.syncInterval = std::chrono::milliseconds(ms);
+      } catch (...) {
+        std::cerr << "Error: Invalid --sync-interval\n";
+        std::exit(1);
+      }
+    } else if (arg == "--adaptive-flush") {
+      config.adaptiveFlush = true;
     } else if (arg == "--atomic-writes") {
       config.atomicWrites = true;
+    } else if (arg == "--incremental") {
+      config.incremental = true;
+    } else if (arg == "--compact-size") {
+      const char *v = requireValue(i, "--compact-size");
+      try {
+        config.compactSize = parseSize(v);
+      } catch (const std::exception &e) {
+        std::cerr << "Error: Invalid --compact-size: " << e.what() << "\n";
+        std::exit(1);
+      }
+    } else if (arg == "--mmap") {
+      config.mmapWindow = true;
+    } else if (arg == "--io-uring") {
+      config.ioUring = true;
+    } else if (arg == "--serve") {
+      config.serve = requireValue(i, "--serve");
+      if (config.serve.rfind("unix:", 0) != 0 &&
+          config.serve.rfind("tcp:", 0) != 0) {
+        std::cerr << "Error: Invalid --serve (use unix:<path> or "
+                     "tcp:<port>)\n";
+        std::exit(1);
+      }
+    } else if (arg == "--include" || arg == "--exclude") {
+      std::string v = requireValue(i, arg.c_str());
+      if (v.empty()) {
+        std::cerr << "Error: " << arg << " needs a non-empty pattern\n";
+        std::exit(1);
+      }
+      config.filters.push_back(
+          {arg == "--include" ? FilterKind::Include : FilterKind::Exclude, v});
+    } else if (arg == "--include-regex" || arg == "--exclude-regex") {
+      std::string v = requireValue(i, arg.c_str());
+      try {
+        std::regex check(v);
+      } catch (const std::regex_error &e) {
+        std::cerr << "Error: Invalid " << arg << ": " << e.what() << "\n";
+        std::exit(1);
+      }
+      config.filters.push_back({arg == "--include-regex"
+                                    ? FilterKind::IncludeRegex
+                                    : FilterKind::ExcludeRegex,
+                                v});
+    } else if (arg == "--sample" || arg == "--rate-limit") {
+      std::string v = requireValue(i, arg.c_str());
+      size_t colon = v.find(':');
+      uint64_t limit = 0;
+      try {
+        if (colon == std::string::npos || colon + 1 == v.size()) {
+          throw std::invalid_argument("missing pattern");
+        }
+        long long n = std::stoll(v.substr(0, colon));
+        if (n <= 0) {
+          throw std::out_of_range("limit");
+        }
+        limit = static_cast<uint64_t>(n);
+      } catch (...) {
+        std::cerr << "Error: Invalid " << arg << " (use <n>:<text>)\n";
+        std::exit(1);
+      }
+      config.filters.push_back({arg == "--sample" ? FilterKind::Sample
+                                                  : FilterKind::RateLimit,
+                                v.substr(colon + 1), limit});
+    } else if (arg == "--collapse-repeats") {
+      config.collapseRepeats = true;
+    } else if (arg == "--timestamps") {
+      config.timestamps = true;
+    } else if (arg == "--resume") {
+      config.resume = true;
+    } else if (arg == "--notify") {
+      config.notify = true;
+    } else if (arg == "--index") {
+      config.lineIndex = true;
+    } else if (arg == "--index-timestamps") {
+      config.lineIndex = true;
+      config.indexTimestamps = true;
+    } else if (arg == "--trim-strategy") {
+      std::string v = requireValue(i, "--trim-strategy");
+      if (v == "rewrite") {
+        config.trimStrategy = TrimStrategy::Rewrite;
+      } else if (v == "collapse") {
+        config.trimStrategy = TrimStrategy::Collapse;
+        config.incremental = true;
+      } else {
+        std::cerr << "Error: Invalid --trim-strategy (use rewrite or "
+                     "collapse)\n";
+        std::exit(1);
+      }
+    } else if (arg == "--input") {
+      std::string v = requireValue(i, "--input");
+      size_t eq = v.find('=');
+      if (eq == 0 || eq == std::string::npos || eq + 1 == v.size()) {
+        std::cerr << "Error: Invalid --input (use <logfile>=<source>)\n";
+        std::exit(1);
+      }
+      config.inputs.push_back({v.substr(0, eq), v.substr(eq + 1)});
+    } else if (arg == "--writer-threads") {
+      const char *v = requireValue(i, "--writer-threads");
+      try {
+        long long n = std::stoll(v);
+        if (n <= 0 || n > 256) {
+          throw std::out_of_range("thread count");
+        }
+        config.writerThreads = static_cast<size_t>(n);
+      } catch (...) {
+        std::cerr << "Error: Invalid --writer-threads (use 1-256)\n";
+        std::exit(1);
+      }
+    } else if (arg == "--memory-budget" || arg == "--min-window") {
+      const char *v = requireValue(i, arg.c_str());
+      try {
+        size_t size = parseSize(v);
+        if (size == 0) {
+          throw std::out_of_range("must be > 0");
+        }
+        (arg == "--memory-budget" ? config.memoryBudget : config.minWindow) =
+            size;
+      } catch (const std::exception &e) {
+        std::cerr << "Error: Invalid " << arg << ": " << e.what() << "\n";
+        std::exit(1);
+      }
+    } else if (arg == "--history" || arg == "--history-segment") {
+      const char *v = requireValue(i, arg.c_str());
+      try {
+        size_t size = parseSize(v);
+        if (size == 0) {
+          throw std::out_of_range("must be > 0");
+        }
+        (arg == "--history" ? config.history : config.historySegment) = size;
+      } catch (const std::exception &e) {
+        std::cerr << "Error: Invalid " << arg << ": " << e.what() << "\n";
+        std::exit(1);
+      }
+    } else if (arg == "--parse-threads") {
+      const char *v = requireValue(i, "--parse-threads");
+      try {
+        long long n = std::stoll(v);
+        if (n <= 0 || n > 256) {
+          throw std::out_of_range("thread count");
+        }
+        config.parseThreads = static_cast<size_t>(n);
+      } catch (...) {
+        std::cerr << "Error: Invalid --parse-threads (use 1-256)\n";
+        std::exit(1);
+      }
     } else if (arg[0] == '-') {
       std::cerr << "Unknown option: " << arg << '\n';
       printUsage(argv[0]);
@@ -175,124 +854,3460 @@ Config parseArgs(int argc, char *argv[]) {
     }
   }
 
-  if (!foundLogFile) {
+  if (foundLogFile) {
+    config.inputs.insert(config.inputs.begin(), {config.logFile, "-"});
+  } else if (config.inputs.empty()) {
     std::cerr << "Error: No logfile specified\n\n";
     printUsage(argv[0]);
     std::exit(1);
   }
 
-  return config;
-}
+  size_t stdinInputs = 0;
+  for (size_t i = 0; i < config.inputs.size(); ++i) {
+    stdinInputs += config.inputs[i].source == "-";
+    for (size_t j = 0; j < i; ++j) {
+      if (config.inputs[j].logFile == config.inputs[i].logFile) {
+        std::cerr << "Error: " << config.inputs[i].logFile
+                  << " is used by more than one input\n";
+        std::exit(1);
+      }
+    }
+  }
+  if (stdinInputs > 1) {
+    std::cerr << "Error: Only one input can read from stdin\n";
+    std::exit(1);
+  }
 
-// ============================================================================
-// LineBuffer: Deque-based line storage with O(1) amortized operations
-// ============================================================================
+  if (config.maxTokens > 0) {
+    if (!maxSizeGiven) {
+      config.maxSize = config.maxTokens * kMaxBytesPerToken;
+    }
+    if (config.compress != Codec::None) {
+      std::cerr << "Error: --max-tokens cannot be combined with --compress\n";
+      std::exit(1);
+    }
+  }
 
-class LineBuffer {
-public:
-  void appendLine(const std::string &line) {
-    lines_.push_back(line + '\n');
-    totalBytes_ += line.size() + 1;
+  if (config.memoryBudget > 0) {
+    size_t streams = config.inputs.size();
+    if (config.minWindow == 0) {
+      config.minWindow = std::max<size_t>(config.memoryBudget / (4 * streams),
+                                          1);
+    }
+    if (config.minWindow * streams > config.memoryBudget) {
+      std::cerr << "Error: --memory-budget is smaller than --min-window for "
+                   "every input\n";
+      std::exit(1);
+    }
+    size_t largest = config.memoryBudget - config.minWindow * (streams - 1);
+    config.maxSize = maxSizeGiven ? std::min(config.maxSize, largest) : largest;
+    if (config.maxSize < config.minWindow) {
+      std::cerr << "Error: --max-size must be >= --min-window\n";
+      std::exit(1);
+    }
+    if (config.mmapWindow || config.compress != Codec::None) {
+      std::cerr << "Error: --memory-budget cannot be combined with --mmap or "
+                   "--compress\n";
+      std::exit(1);
+    }
+  } else if (config.minWindow > 0) {
+    std::cerr << "Error: --min-window needs --memory-budget\n";
+    std::exit(1);
   }
 
-  void trimToMax(size_t maxSize) {
-    while (totalBytes_ > maxSize && !lines_.empty()) {
-      totalBytes_ -= lines_.front().size();
-      lines_.pop_front();
+  if (config.incremental && config.atomicWrites) {
+    std::cerr << "Error: --incremental cannot be combined with "
+                 "--atomic-writes\n";
+    std::exit(1);
+  }
+
+  if (config.mmapWindow && (config.incremental || config.atomicWrites)) {
+    std::cerr << "Error: --mmap cannot be combined with --incremental, "
+                 "--trim-strategy or --atomic-writes\n";
+    std::exit(1);
+  }
+
+  if (config.decompress) {
+    if (!foundLogFile) {
+      std::cerr << "Error: --decompress needs the <logfile> to read\n";
+      std::exit(1);
     }
+    return config;
   }
 
-  void assemble(std::string &out) const {
-    out.clear();
-    out.reserve(totalBytes_);
-    for (const auto &line : lines_) {
-      out += line;
+  if (config.compress != Codec::None &&
+      (config.incremental || config.mmapWindow)) {
+    std::cerr << "Error: --compress cannot be combined with --incremental, "
+                 "--trim-strategy or --mmap\n";
+    std::exit(1);
+  }
+  config.chunkSize = std::min(config.chunkSize, config.maxSize);
+
+  if (!config.serve.empty() &&
+      (config.inputs.size() != 1 || config.compress != Codec::None)) {
+    std::cerr << "Error: --serve needs a single window and cannot be "
+                 "combined with --compress\n";
+    std::exit(1);
+  }
+  if (!config.serve.empty() &&
+      (config.collapseRepeats || config.maxTokens > 0)) {
+    // Clients get the raw input, which would no longer match the window
+    std::cerr << "Error: --serve cannot be combined with --collapse-repeats "
+                 "or --max-tokens\n";
+    std::exit(1);
+  }
+
+  if (config.notify && (config.mmapWindow || config.compress != Codec::None)) {
+    std::cerr << "Error: --notify cannot be combined with --mmap (use its "
+                 ".head sidecar) or --compress\n";
+    std::exit(1);
+  }
+
+  if (config.durability != Durability::None &&
+      (config.mmapWindow || config.compress != Codec::None)) {
+    std::cerr << "Error: --durability cannot be combined with --mmap or "
+                 "--compress\n";
+    std::exit(1);
+  }
+
+  if (config.resume && (config.mmapWindow || config.compress != Codec::None)) {
+    std::cerr << "Error: --resume cannot be combined with --mmap or "
+                 "--compress\n";
+    std::exit(1);
+  }
+
+  if (config.history > 0) {
+    if (config.historySegment == 0) {
+      config.historySegment = std::max<size_t>(config.history / 8, 1);
+    }
+    if (config.historySegment > config.history) {
+      std::cerr << "Error: --history-segment must be <= --history\n";
+      std::exit(1);
+    }
+    if (config.compress != Codec::None) {
+      std::cerr << "Error: --history cannot be combined with --compress\n";
+      std::exit(1);
     }
+  } else if (config.historySegment > 0) {
+    std::cerr << "Error: --history-segment needs --history\n";
+    std::exit(1);
   }
 
-  size_t size() const { return totalBytes_; }
+  if (config.lineIndex &&
+      (config.mmapWindow || config.compress != Codec::None)) {
+    std::cerr << "Error: --index cannot be combined with --mmap or "
+                 "--compress\n";
+    std::exit(1);
+  }
 
-  bool empty() const { return lines_.empty(); }
+  if (config.timestamps && config.maxSize <= Timestamper::kWidth + 1) {
+    std::cerr << "Error: --timestamps needs a --max-size above "
+              << Timestamper::kWidth + 1 << "\n";
+    std::exit(1);
+  }
 
-private:
-  std::deque<std::string> lines_;
-  size_t totalBytes_ = 0;
-};
+  if (config.compactSize == 0) {
+    config.compactSize = 2 * config.maxSize;
+  } else if (config.compactSize < config.maxSize) {
+    std::cerr << "Error: --compact-size must be >= --max-size\n";
+    std::exit(1);
+  }
+
+  return config;
+}
 
 // ============================================================================
-// Writer: Thread-safe writer with time-driven flushes
+// OffsetRing: Growable power-of-two ring of 64-bit offsets
 // ============================================================================
 
-class Writer {
+class OffsetRing {
 public:
-  Writer(const Config &config)
-      : config_(config), interval_(config.writeInterval),
-        immediate_(config.immediate), atomicWrites_(config.atomicWrites),
-        lastFlushTime_(std::chrono::steady_clock::now()) {
-    openFile();
+  void push(uint64_t value) {
+    if (count_ == slots_.size()) {
+      grow();
+    }
+    slots_[(head_ + count_) & (slots_.size() - 1)] = value;
+    ++count_;
   }
 
-  ~Writer() { closeFile(); }
-
-  void appendLine(const std::string &line) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    buffer_.appendLine(line);
-    buffer_.trimToMax(config_.maxSize);
-    dirty_ = true;
-    cv_.notify_one();
+  void pop() {
+    head_ = (head_ + 1) & (slots_.size() - 1);
+    --count_;
   }
 
-  void writerThread() {
-    std::unique_lock<std::mutex> lock(mutex_);
+  uint64_t front() const { return slots_[head_]; }
 
-    while (!shuttingDown_) {
-      if (immediate_) {
-        // Immediate mode: wait for notification
-        cv_.wait(lock, [this] { return dirty_ || shuttingDown_; });
-        if (dirty_) {
-          flushLocked();
-        }
-      } else {
-        // Debounced mode: wait with timeout
-        auto status = cv_.wait_for(lock, interval_);
+  uint64_t operator[](size_t i) const {
+    return slots_[(head_ + i) & (slots_.size() - 1)];
+  }
 
-        // Flush if dirty and either timeout occurred or enough time passed
-        if (dirty_ &&
-            (status == std::cv_status::timeout ||
-             std::chrono::steady_clock::now() - lastFlushTime_ >= interval_)) {
-          flushLocked();
-        }
-      }
-    }
+  size_t size() const { return count_; }
 
-    // Final flush on shutdown
-    if (dirty_) {
-      flushLocked();
-    }
-  }
+  bool empty() const { return count_ == 0; }
 
-  void shutdown() {
-    {
-      std::lock_guard<std::mutex> lock(mutex_);
-      shuttingDown_ = true;
-    }
-    cv_.notify_one();
+  void clear() {
+    head_ = 0;
+    count_ = 0;
   }
 
 private:
-  void openFile() {
-    if (atomicWrites_) {
-      // Atomic writes don't keep file open
-      return;
+  // Doubles capacity; only happens until the ring reaches its steady-state
+  // line count, so appends stay allocation-free afterwards.
+  void grow() {
+    std::vector<uint64_t> bigger(slots_.empty() ? 64 : slots_.size() * 2);
+    for (size_t i = 0; i < count_; ++i) {
+      bigger[i] = (*this)[i];
     }
+    slots_.swap(bigger);
+    head_ = 0;
+  }
 
-    std::error_code ec;
-    // Try to create parent directory if needed
-    auto parent = std::filesystem::path(config_.logFile).parent_path();
+  std::vector<uint64_t> slots_;
+  size_t head_ = 0;
+  size_t count_ = 0;
+};
+
+// ============================================================================
+// LineBuffer: Fixed-capacity byte ring plus a ring of line-start offsets
+// ============================================================================
+//
+// Bytes live in a single allocation of `capacity` bytes. Offsets are logical
+// (they count every byte ever appended and never wrap); the physical position
+// of a logical offset is `offset % capacity`. Appending is a memcpy and
+// dropping the oldest line just advances `begin_`. With trackTokens(), every
+// line also carries a logical token offset in a second ring, so the window's
+// token count is one subtraction and no line is ever counted twice.
+
+class LineBuffer {
+public:
+  struct Segment {
+    const char *data;
+    size_t size;
+  };
+
+  // Uses `storage` (capacity bytes, not owned) when given, e.g. a mapping of
+  // the log file; otherwise allocates its own ring.
+  explicit LineBuffer(size_t capacity, char *storage = nullptr)
+      : capacity_(capacity), owned_(storage ? nullptr : new char[capacity]),
+        data_(storage ? storage : owned_.get()) {}
+
+  // Appends line + '\n', evicting the oldest lines to make room. A line that
+  // could never fit (line.size() + 1 > capacity) is ignored. `tokens` is its
+  // estimateTokens() count when tracking tokens.
+  void appendLine(std::string_view line, size_t tokens = 0) {
+    size_t len = line.size() + 1;
+    if (len > capacity_) {
+      return;
+    }
+    while (capacity_ - size() < len) {
+      popFront();
+    }
+
+    copyIn(end_, line.data(), line.size());
+    data_[(end_ + line.size()) % capacity_] = '\n';
+    starts_.push(end_);
+    end_ += len;
+    if (trackTokens_) {
+      tokenStarts_.push(tokenEnd_);
+      tokenEnd_ += tokens;
+    }
+  }
+
+  void trimToMax(size_t maxSize) {
+    while (size() > maxSize && !empty()) {
+      popFront();
+    }
+  }
+
+  // Keeps a token count per line from now on (--max-tokens). Call while the
+  // buffer is empty.
+  void trackTokens() { trackTokens_ = true; }
+
+  // Evicts the oldest lines until the window holds at most `maxTokens`.
+  // Each eviction is one pop, so this is O(1) per line ever appended.
+  void trimToTokens(size_t maxTokens) {
+    while (tokens() > maxTokens && !empty()) {
+      popFront();
+    }
+  }
+
+  // Estimated tokens in the window (0 unless tracking tokens)
+  size_t tokens() const {
+    return static_cast<size_t>(tokenEnd_ - tokenBegin_);
+  }
+
+  // Moves the window into a new owned ring of `capacity` bytes, evicting the
+  // oldest lines that do not fit. Logical offsets are unchanged. Only for a
+  // ring this buffer allocated itself.
+  void resize(size_t capacity) {
+    trimToMax(capacity);
+    Segment segs[2];
+    size_t count = segments(segs);
+    std::unique_ptr<char[]> old = std::move(owned_);
+    owned_.reset(new char[capacity]);
+    data_ = owned_.get();
+    capacity_ = capacity;
+    uint64_t at = begin_;
+    for (size_t i = 0; i < count; ++i) {
+      copyIn(at, segs[i].data, segs[i].size);
+      at += segs[i].size;
+    }
+  }
+
+  // Describes the window as at most two contiguous ranges of the ring,
+  // oldest first, and returns how many ranges were filled in.
+  size_t segments(Segment out[2]) const { return segmentsFrom(begin_, out); }
+
+  // Same as segments(), restricted to the bytes at logical offsets
+  // [from, endOffset()). `from` must lie within the buffered window.
+  size_t segmentsFrom(uint64_t from, Segment out[2]) const {
+    size_t len = static_cast<size_t>(end_ - from);
+    if (len == 0) {
+      return 0;
+    }
+    size_t pos = from % capacity_;
+    size_t first = std::min(len, capacity_ - pos);
+    out[0] = {data_ + pos, first};
+    if (first == len) {
+      return 1;
+    }
+    out[1] = {data_, len - first};
+    return 2;
+  }
+
+  void assemble(std::string &out) const {
+    out.clear();
+    out.reserve(size());
+    Segment segs[2];
+    size_t count = segments(segs);
+    for (size_t i = 0; i < count; ++i) {
+      out.append(segs[i].data, segs[i].size);
+    }
+  }
+
+  size_t size() const { return static_cast<size_t>(end_ - begin_); }
+
+  bool empty() const { return starts_.empty(); }
+
+  size_t lineCount() const { return starts_.size(); }
+
+  size_t capacity() const { return capacity_; }
+
+  // Logical start offset of the i-th buffered line, oldest first
+  uint64_t lineStart(size_t i) const { return starts_[i]; }
+
+  // True if the bytes at logical offset `offset` (within the window) equal
+  // `text`
+  bool matches(uint64_t offset, std::string_view text) const {
+    if (offset + text.size() > end_) {
+      return false;
+    }
+    size_t pos = offset % capacity_;
+    size_t first = std::min(text.size(), capacity_ - pos);
+    return std::memcmp(data_ + pos, text.data(), first) == 0 &&
+           std::memcmp(data_, text.data() + first, text.size() - first) == 0;
+  }
+
+  // Replaces the bytes of the newest line from logical offset `from` on
+  // with `tail` + '\n', evicting older lines to make room. `tokens` is the
+  // rewritten line's new count when tracking tokens. Leaves the buffer
+  // unchanged and returns false if the rewritten line could never fit.
+  bool rewriteNewestLine(uint64_t from, std::string_view tail,
+                         size_t tokens = 0) {
+    uint64_t start = starts_[starts_.size() - 1];
+    if (from - start + tail.size() + 1 > capacity_) {
+      return false;
+    }
+    end_ = from;
+    while (capacity_ - size() < tail.size() + 1) {
+      popFront(); // Never the newest line itself: it fits on its own
+    }
+    copyIn(end_, tail.data(), tail.size());
+    data_[(end_ + tail.size()) % capacity_] = '\n';
+    end_ += tail.size() + 1;
+    if (trackTokens_) {
+      tokenEnd_ = tokenStarts_[tokenStarts_.size() - 1] + tokens;
+    }
+    return true;
+  }
+
+  // Copies every line evicted from now on, '\n' included, to the end of
+  // `sink` before its bytes can be reused (--history). clear() is not an
+  // eviction and copies nothing.
+  void spillTo(std::string *sink) { spill_ = sink; }
+
+  // Drops every line; offsets keep counting up from endOffset()
+  void clear() {
+    starts_.clear();
+    begin_ = end_;
+    tokenStarts_.clear();
+    tokenBegin_ = tokenEnd_;
+  }
+
+  uint64_t beginOffset() const { return begin_; }
+
+  uint64_t endOffset() const { return end_; }
+
+private:
+  void popFront() {
+    uint64_t from = begin_;
+    starts_.pop();
+    begin_ = starts_.empty() ? end_ : starts_.front();
+    if (trackTokens_) {
+      tokenStarts_.pop();
+      tokenBegin_ = tokenStarts_.empty() ? tokenEnd_ : tokenStarts_.front();
+    }
+    if (spill_) {
+      size_t len = static_cast<size_t>(begin_ - from);
+      size_t pos = from % capacity_;
+      size_t first = std::min(len, capacity_ - pos);
+      spill_->append(data_ + pos, first);
+      spill_->append(data_, len - first);
+    }
+  }
+
+  void copyIn(uint64_t offset, const char *src, size_t len) {
+    size_t pos = offset % capacity_;
+    size_t first = std::min(len, capacity_ - pos);
+    std::memcpy(data_ + pos, src, first);
+    std::memcpy(data_, src + first, len - first);
+  }
+
+  size_t capacity_;
+  std::unique_ptr<char[]> owned_;
+  char *data_;
+  OffsetRing starts_; // Logical start offset of each buffered line
+  uint64_t begin_ = 0; // Logical offset of the oldest buffered byte
+  uint64_t end_ = 0;   // Logical offset one past the newest buffered byte
+  std::string *spill_ = nullptr; // Receives evicted lines (--history)
+  bool trackTokens_ = false;
+  OffsetRing tokenStarts_; // Logical token offset of each buffered line
+  uint64_t tokenBegin_ = 0;
+  uint64_t tokenEnd_ = 0;
+};
+
+// ============================================================================
+// LineQueue: Lock-free single-producer/single-consumer byte ring
+// ============================================================================
+//
+// Carries complete, '\n'-terminated lines from the input reader to the writer
+// thread. The producer copies bytes in and advances `tail_`; the consumer
+// reads (at most two) contiguous segments and advances `head_`. Each index is
+// written by one side only, so no lock is needed.
+
+class LineQueue {
+public:
+  using Segment = LineBuffer::Segment;
+
+  // `capacity` must be a power of two
+  explicit LineQueue(size_t capacity)
+      : capacity_(capacity), data_(new char[capacity]) {}
+
+  // Producer: copies as much of [data, data + len) as fits without
+  // publishing it and returns the number of bytes taken.
+  size_t write(const char *data, size_t len) {
+    size_t space =
+        capacity_ - static_cast<size_t>(
+                        pendingTail_ - head_.load(std::memory_order_acquire));
+    size_t n = std::min(len, space);
+    size_t pos = pendingTail_ & (capacity_ - 1);
+    size_t first = std::min(n, capacity_ - pos);
+    std::memcpy(data_.get() + pos, data, first);
+    std::memcpy(data_.get(), data + first, n - first);
+    pendingTail_ += n;
+    return n;
+  }
+
+  // Producer: makes everything written so far visible to the consumer
+  void publish() { tail_.store(pendingTail_, std::memory_order_release); }
+
+  // Producer: blocks until the consumer frees some space
+  void waitForSpace() {
+    uint64_t head = head_.load(std::memory_order_acquire);
+    while (pendingTail_ - head == capacity_) {
+      head_.wait(head, std::memory_order_acquire);
+      head = head_.load(std::memory_order_acquire);
+    }
+  }
+
+  // Consumer: describes the published bytes, oldest first
+  size_t readable(Segment out[2]) const {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    size_t len =
+        static_cast<size_t>(tail_.load(std::memory_order_acquire) - head);
+    if (len == 0) {
+      return 0;
+    }
+    size_t pos = head & (capacity_ - 1);
+    size_t first = std::min(len, capacity_ - pos);
+    out[0] = {data_.get() + pos, first};
+    if (first == len) {
+      return 1;
+    }
+    out[1] = {data_.get(), len - first};
+    return 2;
+  }
+
+  // Consumer: releases `len` bytes back to the producer
+  void consume(size_t len) {
+    head_.fetch_add(len, std::memory_order_release);
+    head_.notify_one();
+  }
+
+  bool empty() const {
+    return tail_.load(std::memory_order_acquire) ==
+           head_.load(std::memory_order_relaxed);
+  }
+
+  // Rounds the queue up to a power of two between 1 MiB and 64 MiB that can
+  // hold two windows, so short disk stalls do not backpressure the pipe
+  static size_t capacityFor(size_t maxSize) {
+    size_t capacity = size_t{1} << 20;
+    while (capacity < 2 * maxSize && capacity < (size_t{64} << 20)) {
+      capacity <<= 1;
+    }
+    return capacity;
+  }
+
+private:
+  size_t capacity_;
+  std::unique_ptr<char[]> data_;
+  uint64_t pendingTail_ = 0; // Producer-private
+  alignas(64) std::atomic<uint64_t> tail_{0};
+  alignas(64) std::atomic<uint64_t> head_{0};
+};
+
+// ============================================================================
+// ChunkStore: The window as independently compressed chunks (--compress)
+// ============================================================================
+
+const char *codecExtension(Codec codec) {
+  return codec == Codec::Zstd ? ".zst" : "";
+}
+
+// Compresses `in` into `out` as one self-contained frame
+bool compressFrame(Codec codec, std::string_view in, int level,
+                   std::string &out) {
+#if LOGWINDOW_WITH_ZSTD
+  if (codec == Codec::Zstd) {
+    out.resize(ZSTD_compressBound(in.size()));
+    size_t n = ZSTD_compress(out.data(), out.size(), in.data(), in.size(),
+                             level);
+    if (ZSTD_isError(n)) {
+      return false;
+    }
+    out.resize(n);
+    return true;
+  }
+#endif
+  (void)codec;
+  (void)in;
+  (void)level;
+  (void)out;
+  return false;
+}
+
+bool decompressFrame(Codec codec, std::string_view in, std::string &out) {
+#if LOGWINDOW_WITH_ZSTD
+  if (codec == Codec::Zstd) {
+    unsigned long long size = ZSTD_getFrameContentSize(in.data(), in.size());
+    if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN) {
+      return false;
+    }
+    out.resize(static_cast<size_t>(size));
+    size_t n = ZSTD_decompress(out.data(), out.size(), in.data(), in.size());
+    return !ZSTD_isError(n) && n == out.size();
+  }
+#endif
+  (void)codec;
+  (void)in;
+  (void)out;
+  return false;
+}
+
+// Sealed chunks of the window, oldest first, one file per chunk named
+// <logfile>.chunks/<16 hex digit sequence><ext>. Every chunk holds whole
+// lines in one frame, so the head of the window is trimmed by deleting
+// files and nothing is ever recompressed. Files appear via rename, so a
+// reader never sees a partial chunk.
+class ChunkStore {
+public:
+  explicit ChunkStore(const Config &config)
+      : dir_(config.logFile + ".chunks"), codec_(config.compress),
+        level_(config.compressLevel) {}
+
+  bool active() const { return codec_ != Codec::None; }
+
+  uint64_t rawBytes() const { return rawBytes_; }
+
+  // Starts an empty window, removing chunks left by an earlier run
+  bool reset() {
+    std::error_code ec;
+    std::filesystem::remove_all(dir_, ec);
+    return std::filesystem::create_directories(dir_, ec);
+  }
+
+  // Compresses `data` (whole '\n'-terminated lines) into the next chunk
+  bool seal(std::string_view data, size_t lines) {
+    if (!compressFrame(codec_, data, level_, compressed_)) {
+      return false;
+    }
+    std::filesystem::path path = pathFor(nextSeq_);
+    std::filesystem::path tmp = path;
+    tmp += ".tmp";
+    {
+      std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+      out.write(compressed_.data(),
+                static_cast<std::streamsize>(compressed_.size()));
+      if (!out) {
+        return false;
+      }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+      return false;
+    }
+    chunks_.push_back({nextSeq_++, data.size(), lines});
+    rawBytes_ += data.size();
+    return true;
+  }
+
+  // Deletes the oldest chunks while the rest, plus the `openBytes` not yet
+  // sealed, still cover `windowBytes`. Returns how many lines went with them.
+  size_t trim(size_t windowBytes, size_t openBytes) {
+    size_t evicted = 0;
+    while (!chunks_.empty() &&
+           rawBytes_ - chunks_.front().rawBytes + openBytes >= windowBytes) {
+      std::error_code ec;
+      std::filesystem::remove(pathFor(chunks_.front().seq), ec);
+      rawBytes_ -= chunks_.front().rawBytes;
+      evicted += chunks_.front().lines;
+      chunks_.pop_front();
+    }
+    return evicted;
+  }
+
+private:
+  struct Chunk {
+    uint64_t seq;
+    size_t rawBytes;
+    size_t lines;
+  };
+
+  std::filesystem::path pathFor(uint64_t seq) const {
+    static const char *hex = "0123456789abcdef";
+    std::string name(16, '0');
+    for (int i = 15; i >= 0; --i, seq >>= 4) {
+      name[static_cast<size_t>(i)] = hex[seq & 0xf];
+    }
+    return dir_ / (name + codecExtension(codec_));
+  }
+
+  std::filesystem::path dir_;
+  Codec codec_;
+  int level_;
+  std::deque<Chunk> chunks_;
+  uint64_t nextSeq_ = 0;
+  uint64_t rawBytes_ = 0;     // Uncompressed bytes in chunks_
+  std::string compressed_;    // Reused output buffer
+};
+
+// `logwindow <logfile> --decompress`: writes the window of a --compress log
+// to stdout, every sealed chunk oldest first and then the open chunk kept
+// in <logfile> itself. Consistent only once logwindow has stopped: a chunk
+// sealed between the listing and the read of <logfile> is missing or, if
+// <logfile> still holds its lines, printed twice. A chunk trimmed since
+// the listing is skipped.
+int decompressWindow(const std::string &logFile) {
+  std::vector<std::filesystem::path> chunks;
+  std::error_code ec;
+  for (const auto &entry :
+       std::filesystem::directory_iterator(logFile + ".chunks", ec)) {
+    if (entry.path().extension() == codecExtension(Codec::Zstd)) {
+      chunks.push_back(entry.path());
+    }
+  }
+  std::sort(chunks.begin(), chunks.end());
+
+  auto readFile = [](const std::filesystem::path &path, std::string &out) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+      return false;
+    }
+    out.assign(std::istreambuf_iterator<char>(in),
+               std::istreambuf_iterator<char>());
+    return true;
+  };
+
+  std::string compressed;
+  std::string plain;
+  for (const auto &path : chunks) {
+    if (!readFile(path, compressed)) {
+      continue; // Trimmed since the listing
+    }
+    if (!decompressFrame(Codec::Zstd, compressed, plain)) {
+      std::cerr << "Error: Cannot decompress " << path.string()
+#if !LOGWINDOW_WITH_ZSTD
+                << " (this build has no zstd support)"
+#endif
+                << '\n';
+      return 1;
+    }
+    std::cout.write(plain.data(), static_cast<std::streamsize>(plain.size()));
+  }
+  if (readFile(logFile, plain)) {
+    std::cout.write(plain.data(), static_cast<std::streamsize>(plain.size()));
+  }
+  std::cout.flush();
+  return std::cout ? 0 : 1;
+}
+
+// ============================================================================
+// HistoryLog: Evicted lines as append-only, size-rotated segments (--history)
+// ============================================================================
+//
+// Lines leaving the window are appended, oldest first, to
+// <logfile>.history/<16 hex digit sequence>.log. A segment is closed once the
+// next batch would take it past --history-segment and is never written
+// again; the oldest segments are deleted while the rest exceed --history.
+// Concatenating the segments and then <logfile> gives the stream in order.
+
+class HistoryLog {
+public:
+  // Evicted bytes staged in memory before they are written as one batch
+  static constexpr size_t kBatchSize = 1024 * 1024;
+  // Longest evicted bytes wait for a batch to fill
+  static constexpr std::chrono::seconds kMaxDelay{1};
+
+  explicit HistoryLog(const Config &config)
+      : dir_(config.logFile + ".history"), limit_(config.history),
+        segmentSize_(config.historySegment) {}
+
+  bool active() const { return limit_ > 0; }
+
+  // Picks up the segments of an earlier run; new lines go to a fresh segment
+  // after them, and old ones count toward the limit like any others
+  bool open() {
+    std::error_code ec;
+    std::filesystem::create_directories(dir_, ec);
+    if (ec) {
+      return false;
+    }
+    for (const auto &entry : std::filesystem::directory_iterator(dir_, ec)) {
+      std::string stem = entry.path().stem().string();
+      if (entry.path().extension() != ".log" || stem.size() != 16 ||
+          stem.find_first_not_of("0123456789abcdef") != std::string::npos) {
+        continue;
+      }
+      std::error_code sizeEc;
+      uint64_t size = entry.file_size(sizeEc);
+      segments_.push_back({std::stoull(stem, nullptr, 16), sizeEc ? 0 : size});
+    }
+    std::sort(segments_.begin(), segments_.end(),
+              [](const Segment &a, const Segment &b) { return a.seq < b.seq; });
+    for (const Segment &segment : segments_) {
+      bytes_ += segment.size;
+    }
+    nextSeq_ = segments_.empty() ? 0 : segments_.back().seq + 1;
+    trim();
+    return true;
+  }
+
+  // Appends `data` (whole '\n'-terminated lines). A batch is split at a line
+  // boundary where the newest segment fills up, so segments stay within
+  // --history-segment except for a single longer line.
+  bool append(std::string_view data) {
+    while (!data.empty()) {
+      size_t room = segmentSize_ - std::min(written_, segmentSize_);
+      size_t take = data.size();
+      if (take > room) {
+        size_t nl = room > 0 ? data.rfind('\n', room - 1) : std::string::npos;
+        if (nl != std::string::npos) {
+          take = nl + 1;
+        } else if (written_ > 0) {
+          rotate();
+          continue;
+        } else {
+          take = data.find('\n') + 1; // A line longer than a segment
+        }
+      }
+      if (!out_.is_open() && !startSegment()) {
+        return false;
+      }
+      out_.write(data.data(), static_cast<std::streamsize>(take));
+      written_ += take;
+      segments_.back().size += take;
+      bytes_ += take;
+      data.remove_prefix(take);
+    }
+    out_.flush();
+    trim();
+    return static_cast<bool>(out_);
+  }
+
+private:
+  struct Segment {
+    uint64_t seq;
+    uint64_t size;
+  };
+
+  bool startSegment() {
+    out_.clear();
+    out_.open(pathFor(nextSeq_), std::ios::binary | std::ios::app);
+    if (!out_) {
+      return false;
+    }
+    segments_.push_back({nextSeq_++, 0});
+    written_ = 0;
+    return true;
+  }
+
+  void rotate() {
+    out_.close();
+    written_ = 0;
+  }
+
+  // Deletes the oldest segments, never the open one, while over the limit
+  void trim() {
+    size_t keep = out_.is_open() ? 1 : 0;
+    while (segments_.size() > keep && bytes_ > limit_) {
+      std::error_code ec;
+      std::filesystem::remove(pathFor(segments_.front().seq), ec);
+      bytes_ -= segments_.front().size;
+      segments_.pop_front();
+    }
+  }
+
+  std::filesystem::path pathFor(uint64_t seq) const {
+    static const char *hex = "0123456789abcdef";
+    std::string name(16, '0');
+    for (int i = 15; i >= 0; --i, seq >>= 4) {
+      name[static_cast<size_t>(i)] = hex[seq & 0xf];
+    }
+    return dir_ / (name + ".log");
+  }
+
+  std::filesystem::path dir_;
+  size_t limit_;
+  size_t segmentSize_;
+  std::deque<Segment> segments_; // Oldest first; the open one is the last
+  std::ofstream out_;
+  uint64_t nextSeq_ = 0;
+  uint64_t bytes_ = 0;  // Total size of segments_
+  size_t written_ = 0;  // Bytes in the open segment
+};
+
+// ============================================================================
+// LineIndex: Binary sidecar of line offsets and arrival times (--index)
+// ============================================================================
+//
+// `<logfile>.idx` describes the lines in `<logfile>` as of the last flush:
+//   magic[8] = "LOGIDX1", then little-endian uint64 `count`, `flags`
+//   (bit 0: times present) and `fileSize`;
+//   uint64 offset[count]: file position of each line's first byte;
+//   int64 time[count], if flagged: microseconds since the Unix epoch at
+//   which the line entered the window.
+// Both arrays are ascending, so "the last N lines" start at
+// offset[count - N] and "everything since T" is a binary search of time[].
+// The index is renamed into place after the log file write completes, so a
+// reader always maps one consistent snapshot and never an offset past
+// `fileSize`.
+
+class LineIndex {
+public:
+  static constexpr size_t kHeaderSize = 32;
+  static constexpr uint64_t kHasTimes = 1;
+
+  explicit LineIndex(const Config &config)
+      : path_(config.logFile + ".idx"), enabled_(config.lineIndex),
+        times_(config.indexTimestamps) {}
+
+  bool active() const { return enabled_; }
+
+  // Records that every line from logical offset `start` on arrived at
+  // `micros` (by default, now).
+  // Lines drained together share one entry, so stamping costs one coarse
+  // clock read per batch rather than per line. It is the clock behind
+  // --timestamps, so both agree to within the hand-off latency.
+  void stamp(uint64_t start, int64_t micros = coarseMicros()) {
+    if (!times_) {
+      return;
+    }
+    runStarts_.push(start);
+    runTimes_.push(static_cast<uint64_t>(micros));
+  }
+
+  // Forgets batches that lie entirely before logical offset `begin`
+  void trim(uint64_t begin) {
+    while (runStarts_.size() > 1 && runStarts_[1] <= begin) {
+      runStarts_.pop();
+      runTimes_.pop();
+    }
+  }
+
+  // Rewrites the index for `buffer`, whose logical offset `fileStart` is
+  // byte 0 of the log file
+  bool write(const LineBuffer &buffer, uint64_t fileStart) {
+    size_t count = buffer.lineCount();
+    scratch_.resize(kHeaderSize + count * 8 * (times_ ? 2 : 1));
+    char *out = scratch_.data();
+    std::memcpy(out, "LOGIDX1", 8);
+    uint64_t header[3] = {count, times_ ? kHasTimes : 0,
+                          buffer.endOffset() - fileStart};
+    std::memcpy(out + 8, header, sizeof(header));
+
+    char *offsets = out + kHeaderSize;
+    char *times = offsets + count * 8;
+    size_t run = 0;
+    for (size_t i = 0; i < count; ++i) {
+      uint64_t start = buffer.lineStart(i);
+      uint64_t offset = start - fileStart;
+      std::memcpy(offsets + i * 8, &offset, 8);
+      if (times_) {
+        while (run + 1 < runStarts_.size() && runStarts_[run + 1] <= start) {
+          ++run;
+        }
+        uint64_t time = runStarts_.empty() ? 0 : runTimes_[run];
+        std::memcpy(times + i * 8, &time, 8);
+      }
+    }
+
+    std::string tmp = path_ + ".tmp";
+    {
+      std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+      file.write(scratch_.data(),
+                 static_cast<std::streamsize>(scratch_.size()));
+      if (!file) {
+        return false;
+      }
+    }
+    if (std::rename(tmp.c_str(), path_.c_str()) != 0) {
+      std::remove(tmp.c_str());
+      return false;
+    }
+    return true;
+  }
+
+private:
+  std::string path_;
+  bool enabled_;
+  bool times_;
+  OffsetRing runStarts_; // First logical offset of each drained batch
+  OffsetRing runTimes_;  // Its arrival time, in microseconds
+  std::string scratch_;  // Reused file image
+};
+
+// ============================================================================
+// Resume: Recovering the window from an existing log file (--resume)
+// ============================================================================
+
+// The end of an existing log file, as read for --resume
+struct LogTail {
+  std::string_view text; // Last maxBytes bytes, plus the byte before them
+  int64_t mtimeUs = 0;   // Last modification, microseconds since the epoch
+};
+
+// Returns the whole lines within the last `maxBytes` bytes of `text`. When
+// `text` is longer, its extra leading byte is the one before the cut, which
+// tells whether the cut falls on a line boundary; otherwise the partial
+// first line is skipped with one memchr. Nothing before the cut is read, so
+// this is O(window) however large the file.
+std::string_view tailLines(std::string_view text, size_t maxBytes) {
+  if (text.size() <= maxBytes) {
+    return text;
+  }
+  size_t cut = text.size() - maxBytes;
+  if (text[cut - 1] != '\n') {
+    const void *nl = std::memchr(text.data() + cut, '\n', text.size() - cut);
+    if (!nl) {
+      return {}; // A single line longer than the window
+    }
+    cut = static_cast<size_t>(static_cast<const char *>(nl) - text.data()) + 1;
+  }
+  return text.substr(cut);
+}
+
+// ============================================================================
+// POSIX File Helpers
+// ============================================================================
+
+#if POSIX_AVAILABLE
+
+// Writes every byte described by `iov` starting at `offset`, retrying short
+// writes and EINTR. Modifies `iov` in place.
+bool writeFully(int fd, struct iovec *iov, int count, off_t offset) {
+  while (count > 0) {
+    ssize_t n = ::pwritev(fd, iov, count, offset);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    offset += n;
+    size_t left = static_cast<size_t>(n);
+    while (count > 0 && left >= iov->iov_len) {
+      left -= iov->iov_len;
+      ++iov;
+      --count;
+    }
+    if (count > 0) {
+      iov->iov_base = static_cast<char *>(iov->iov_base) + left;
+      iov->iov_len -= left;
+    }
+  }
+  return true;
+}
+
+// Forces `fd`'s data to stable storage: fdatasync, or fsync where there is
+// none (macOS)
+int syncData(int fd) {
+#if defined(__APPLE__)
+  return ::fsync(fd);
+#else
+  return ::fdatasync(fd);
+#endif
+}
+
+// Creates a non-blocking listening unix stream socket at `path`, replacing a
+// stale socket file left by an earlier run. Returns -1 with errno set.
+int listenUnixSocket(const std::string &path) {
+  struct sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  std::memcpy(addr.sun_path, path.data(), path.size());
+
+  struct stat st;
+  if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+    ::unlink(path.c_str());
+  }
+
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 ||
+      bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) !=
+          0 ||
+      ::listen(fd, SOMAXCONN) != 0 || fcntl(fd, F_SETFL, O_NONBLOCK) != 0 ||
+      fcntl(fd, F_SETFD, FD_CLOEXEC) != 0) {
+    int err = errno;
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    errno = err;
+    return -1;
+  }
+  return fd;
+}
+
+// Same for a TCP port on 127.0.0.1 only
+int listenTcpLoopback(uint16_t port) {
+  struct sockaddr_in addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  if (fd < 0 ||
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+      bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) !=
+          0 ||
+      ::listen(fd, SOMAXCONN) != 0 || fcntl(fd, F_SETFL, O_NONBLOCK) != 0 ||
+      fcntl(fd, F_SETFD, FD_CLOEXEC) != 0) {
+    int err = errno;
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    errno = err;
+    return -1;
+  }
+  return fd;
+}
+
+// ============================================================================
+// MappedWindow: Log file mapped as a ring buffer (--mmap)
+// ============================================================================
+//
+// The log file is sized to maxSize bytes and mapped shared, and LineBuffer
+// writes its ring straight into the mapping. A small `<logfile>.head`
+// sidecar publishes the logical offsets; byte `o` of the window lives at
+// file position `o % capacity`. Readers follow a seqlock: read `sequence`
+// (retry while odd), read begin/end and copy the bytes, then retry if
+// `sequence` changed. The only syscall on the flush path is msync.
+
+class MappedWindow {
+public:
+  struct Header {
+    char magic[8]; // "LOGWIN1"
+    uint64_t capacity;
+    std::atomic<uint64_t> sequence;
+    std::atomic<uint64_t> begin; // Logical offset of the oldest byte
+    std::atomic<uint64_t> end;   // Logical offset one past the newest byte
+  };
+
+  explicit MappedWindow(const Config &config) {
+    if (!config.mmapWindow) {
+      return;
+    }
+    if (!map(config.logFile, config.maxSize)) {
+      std::cerr << "Error: Failed to map " << config.logFile << ": "
+                << std::strerror(errno)
+                << " (falling back to in-place writes)\n";
+      unmap();
+    }
+  }
+
+  ~MappedWindow() { unmap(); }
+
+  MappedWindow(const MappedWindow &) = delete;
+  MappedWindow &operator=(const MappedWindow &) = delete;
+
+  bool active() const { return data_ != nullptr; }
+
+  char *data() const { return data_; }
+
+  // Brackets a mutation of the ring so readers can detect torn copies
+  void beginUpdate() {
+    header_->sequence.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  void endUpdate(uint64_t begin, uint64_t end) {
+    header_->begin.store(begin, std::memory_order_relaxed);
+    header_->end.store(end, std::memory_order_relaxed);
+    header_->sequence.fetch_add(1, std::memory_order_release);
+  }
+
+  // Schedules write-back of dirty pages; readers already see every update
+  bool sync() {
+    return ::msync(data_, capacity_, MS_ASYNC) == 0 &&
+           ::msync(header_, sizeof(Header), MS_ASYNC) == 0;
+  }
+
+  // Rewrites the file as the plain-text window (oldest line first) so it is
+  // readable without the sidecar once logwindow exits.
+  bool linearize(const LineBuffer &buffer) {
+    std::string content;
+    buffer.assemble(content);
+
+    beginUpdate();
+    struct iovec iov = {content.data(), content.size()};
+    bool ok = writeFully(fd_, &iov, 1, 0) &&
+              ::ftruncate(fd_, static_cast<off_t>(content.size())) == 0;
+    header_->capacity = content.size();
+    endUpdate(0, content.size());
+    ::msync(header_, sizeof(Header), MS_SYNC);
+    return ok;
+  }
+
+private:
+  bool map(const std::string &path, size_t capacity) {
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0 || ::ftruncate(fd_, static_cast<off_t>(capacity)) != 0) {
+      return false;
+    }
+    void *data = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        fd_, 0);
+    if (data == MAP_FAILED) {
+      return false;
+    }
+    data_ = static_cast<char *>(data);
+    capacity_ = capacity;
+
+    std::string headPath = path + ".head";
+    headerFd_ = ::open(headPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                       0644);
+    if (headerFd_ < 0 || ::ftruncate(headerFd_, sizeof(Header)) != 0) {
+      return false;
+    }
+    void *header = ::mmap(nullptr, sizeof(Header), PROT_READ | PROT_WRITE,
+                          MAP_SHARED, headerFd_, 0);
+    if (header == MAP_FAILED) {
+      return false;
+    }
+    header_ = new (header) Header{};
+    std::memcpy(header_->magic, "LOGWIN1", 8);
+    header_->capacity = capacity;
+    return true;
+  }
+
+  void unmap() {
+    if (data_) {
+      ::munmap(data_, capacity_);
+      data_ = nullptr;
+    }
+    if (header_) {
+      ::munmap(header_, sizeof(Header));
+      header_ = nullptr;
+    }
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+    if (headerFd_ >= 0) {
+      ::close(headerFd_);
+      headerFd_ = -1;
+    }
+  }
+
+  int fd_ = -1;
+  int headerFd_ = -1;
+  char *data_ = nullptr;
+  size_t capacity_ = 0;
+  Header *header_ = nullptr;
+};
+
+// ============================================================================
+// ChangeNotifier: Flush generation and changed range sidecar (--notify)
+// ============================================================================
+//
+// `<logfile>.gen` is a mapped header updated after every flush has reached
+// the file. Offsets are logical (bytes of input since startup):
+//   magic[8] = "LOGGEN1"; uint32 `generation`, +1 per flush; uint32 pad;
+//   uint64 `sequence` (seqlock, odd while updating), `file_start` (offset
+//   at file byte 0), `begin`/`end` (the window), `changed` (the previous
+//   generation's `end`).
+// A reader that has consumed up to offset `e` fetches only the new bytes,
+// file range [max(e, begin) - file_start, end - file_start); with
+// `changed` < `begin`, lines were evicted before it could read them. On
+// Linux it can block in FUTEX_WAIT on `generation` instead of polling.
+
+class ChangeNotifier {
+public:
+  struct Header {
+    char magic[8]; // "LOGGEN1"
+    std::atomic<uint32_t> generation;
+    uint32_t pad;
+    std::atomic<uint64_t> sequence;
+    std::atomic<uint64_t> fileStart;
+    std::atomic<uint64_t> begin;
+    std::atomic<uint64_t> end;
+    std::atomic<uint64_t> changed;
+  };
+
+  explicit ChangeNotifier(const Config &config) {
+    if (config.notify && !map(config.logFile + ".gen")) {
+      std::cerr << "Error: Failed to create " << config.logFile
+                << ".gen: " << std::strerror(errno) << '\n';
+      unmap();
+    }
+  }
+
+  ~ChangeNotifier() { unmap(); }
+
+  ChangeNotifier(const ChangeNotifier &) = delete;
+  ChangeNotifier &operator=(const ChangeNotifier &) = delete;
+
+  bool active() const { return header_ != nullptr; }
+
+  // Announces a flush of the window [begin, end), with logical offset
+  // `fileStart` at file byte 0, and wakes blocked readers. `rewrittenFrom`
+  // is the lowest offset changed in place since the last flush (a collapsed
+  // repeat), or UINT64_MAX.
+  void publish(uint64_t fileStart, uint64_t begin, uint64_t end,
+               uint64_t rewrittenFrom) {
+    header_->sequence.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    header_->changed.store(std::min(lastEnd_, rewrittenFrom),
+                           std::memory_order_relaxed);
+    header_->fileStart.store(fileStart, std::memory_order_relaxed);
+    header_->begin.store(begin, std::memory_order_relaxed);
+    header_->end.store(end, std::memory_order_relaxed);
+    header_->sequence.fetch_add(1, std::memory_order_release);
+    header_->generation.fetch_add(1, std::memory_order_release);
+    lastEnd_ = end;
+#ifdef __linux__
+    // Shared (not FUTEX_PRIVATE) so waiters in other processes wake too
+    ::syscall(SYS_futex, &header_->generation, FUTEX_WAKE, INT32_MAX,
+              nullptr, nullptr, 0);
+#endif
+  }
+
+private:
+  bool map(const std::string &path) {
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0 || ::ftruncate(fd_, sizeof(Header)) != 0) {
+      return false;
+    }
+    void *header = ::mmap(nullptr, sizeof(Header), PROT_READ | PROT_WRITE,
+                          MAP_SHARED, fd_, 0);
+    if (header == MAP_FAILED) {
+      return false;
+    }
+    header_ = new (header) Header{};
+    std::memcpy(header_->magic, "LOGGEN1", 8);
+    return true;
+  }
+
+  void unmap() {
+    if (header_) {
+      ::munmap(header_, sizeof(Header));
+      header_ = nullptr;
+    }
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  int fd_ = -1;
+  Header *header_ = nullptr;
+  uint64_t lastEnd_ = 0;
+};
+
+#endif // POSIX_AVAILABLE
+
+#if IOURING_AVAILABLE
+
+// ============================================================================
+// IoUring: Minimal submission/completion ring for the flush path
+// ============================================================================
+
+class IoUring {
+public:
+  // IORING_OP_FTRUNCATE (Linux 6.9+) is missing from older uapi headers
+  static constexpr uint8_t kOpFtruncate = 55;
+
+  IoUring() = default;
+  ~IoUring() { teardown(); }
+
+  IoUring(const IoUring &) = delete;
+  IoUring &operator=(const IoUring &) = delete;
+
+  bool setup(unsigned entries) {
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd_ < 0) {
+      return false;
+    }
+
+    sqSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+      sqSize_ = cqSize_ = std::max(sqSize_, cqSize_);
+    }
+    sqRing_ = ::mmap(nullptr, sqSize_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED) {
+      sqRing_ = nullptr;
+      return false;
+    }
+    cqRing_ = single ? sqRing_
+                     : ::mmap(nullptr, cqSize_, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, fd_,
+                              IORING_OFF_CQ_RING);
+    if (cqRing_ == MAP_FAILED) {
+      cqRing_ = nullptr;
+      return false;
+    }
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = ::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      return false;
+    }
+    sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+    char *sq = static_cast<char *>(sqRing_);
+    char *cq = static_cast<char *>(cqRing_);
+    sqHead_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    cqHead_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    entries_ = params.sq_entries;
+    return true;
+  }
+
+  void teardown() {
+    if (sqes_) {
+      ::munmap(sqes_, sqesSize_);
+      sqes_ = nullptr;
+    }
+    if (cqRing_ && cqRing_ != sqRing_) {
+      ::munmap(cqRing_, cqSize_);
+    }
+    cqRing_ = nullptr;
+    if (sqRing_) {
+      ::munmap(sqRing_, sqSize_);
+      sqRing_ = nullptr;
+    }
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  bool active() const { return sqes_ != nullptr; }
+
+  // Returns a zeroed SQE to fill in, or nullptr if the ring is full
+  io_uring_sqe *nextSqe() {
+    unsigned head = std::atomic_ref<unsigned>(*sqHead_).load(
+        std::memory_order_acquire);
+    if (pendingTail_ - head >= entries_) {
+      return nullptr;
+    }
+    unsigned index = pendingTail_ & sqMask_;
+    io_uring_sqe *sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqArray_[index] = index;
+    ++pendingTail_;
+    return sqe;
+  }
+
+  // Publishes queued SQEs and submits them without waiting for completion
+  bool submit() {
+    unsigned count = pendingTail_ - *sqTail_;
+    std::atomic_ref<unsigned>(*sqTail_).store(pendingTail_,
+                                              std::memory_order_release);
+    while (count > 0) {
+      int n = static_cast<int>(
+          ::syscall(__NR_io_uring_enter, fd_, count, 0, 0, nullptr, 0));
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      count -= static_cast<unsigned>(n);
+    }
+    return true;
+  }
+
+  // Blocks until a completion is available and pops it
+  bool waitCqe(io_uring_cqe &out) {
+    while (true) {
+      unsigned head = *cqHead_;
+      unsigned tail = std::atomic_ref<unsigned>(*cqTail_).load(
+          std::memory_order_acquire);
+      if (head != tail) {
+        out = cqes_[head & cqMask_];
+        std::atomic_ref<unsigned>(*cqHead_).store(head + 1,
+                                                  std::memory_order_release);
+        return true;
+      }
+      if (::syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS,
+                    nullptr, 0) < 0 &&
+          errno != EINTR) {
+        return false;
+      }
+    }
+  }
+
+private:
+  int fd_ = -1;
+  void *sqRing_ = nullptr;
+  void *cqRing_ = nullptr;
+  io_uring_sqe *sqes_ = nullptr;
+  size_t sqSize_ = 0;
+  size_t cqSize_ = 0;
+  size_t sqesSize_ = 0;
+  unsigned *sqHead_ = nullptr;
+  unsigned *sqTail_ = nullptr;
+  unsigned *sqArray_ = nullptr;
+  unsigned sqMask_ = 0;
+  unsigned *cqHead_ = nullptr;
+  unsigned *cqTail_ = nullptr;
+  unsigned cqMask_ = 0;
+  io_uring_cqe *cqes_ = nullptr;
+  unsigned entries_ = 0;
+  unsigned pendingTail_ = 0; // SQEs filled in but not yet published
+};
+
+#endif // IOURING_AVAILABLE
+
+// ============================================================================
+// Statistics: Per-stream counters, read without stopping the hot path
+// ============================================================================
+
+// Counter with a single writing thread: a relaxed load and store instead of
+// a locked read-modify-write, so bumping it costs the same as a plain add.
+// Any thread may read it.
+class StatCounter {
+public:
+  void add(uint64_t n) {
+    value_.store(value_.load(std::memory_order_relaxed) + n,
+                 std::memory_order_relaxed);
+  }
+
+  uint64_t get() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<uint64_t> value_{0};
+};
+
+// Each side's counters sit on their own cache line, so the reader and the
+// writer thread never invalidate each other's line. Counters are bumped
+// once per read() chunk, queue stall or flush; never per line.
+struct StreamStats {
+  static constexpr size_t kBuckets = 40; // Bucket i: durations < 2^i us
+
+  struct alignas(64) ReaderSide {
+    StatCounter linesIn;
+    StatCounter bytesIn;
+    StatCounter linesDropped; // Overlong lines
+    StatCounter linesFiltered; // Rejected by --include/--exclude/--sample...
+    StatCounter queueStalls;  // Times the reader waited for queue space
+    StatCounter queueWaitUs;
+  };
+
+  struct alignas(64) WriterSide {
+    StatCounter linesEvicted;
+    StatCounter linesCollapsed; // Repeats folded into the previous line
+    StatCounter flushes;
+    StatCounter flushUs[kBuckets];
+  };
+
+  ReaderSide reader;
+  WriterSide writer;
+
+  void recordFlush(std::chrono::steady_clock::duration elapsed) {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed);
+    size_t bucket = std::bit_width(static_cast<uint64_t>(us.count()));
+    writer.flushUs[std::min(bucket, kBuckets - 1)].add(1);
+    writer.flushes.add(1);
+  }
+
+  // Upper bound of the histogram bucket holding quantile `q` (0 if empty)
+  uint64_t flushQuantileUs(double q) const {
+    uint64_t counts[kBuckets];
+    uint64_t total = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+      counts[i] = writer.flushUs[i].get();
+      total += counts[i];
+    }
+    uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+      seen += counts[i];
+      if (counts[i] > 0 && seen > rank) {
+        return uint64_t{1} << i;
+      }
+    }
+    return 0;
+  }
+};
+
+// ============================================================================
+// MemoryBudget: One byte budget shared by every window (--memory-budget)
+// ============================================================================
+//
+// Every window is guaranteed --min-window bytes. The rest of the budget is
+// divided again about once a second in proportion to each stream's recent
+// input rate (an exponentially weighted average of bytes per interval), so
+// busy streams keep more history and idle ones shrink to their minimum.
+// Shares that would exceed --max-size are capped and the excess goes to
+// the others. Each writer applies its own share on its own thread by
+// resizing its ring, evicting its oldest lines; the memory is returned
+// rather than just left unused. A share that shrinks is applied within one
+// interval, so the total can exceed the budget only briefly. Limits move
+// only by at least a quantum, unless the bytes are needed elsewhere or
+// would otherwise go unused, so small rate changes resize nothing while
+// the limits still add up to the budget.
+
+class MemoryBudget {
+public:
+  static constexpr auto kInterval = std::chrono::seconds(1);
+
+  // A stream's share of the budget, recomputed by rebalance()
+  struct Share {
+    const StatCounter *bytesIn = nullptr;
+    uint64_t lastBytes = 0;
+    double rate = 0; // Bytes per interval, smoothed
+    std::atomic<size_t> limit{0};
+  };
+
+  MemoryBudget(size_t budget, size_t minWindow, size_t maxWindow)
+      : budget_(budget), minWindow_(minWindow), maxWindow_(maxWindow) {}
+
+  bool active() const { return budget_ > 0; }
+
+  // Adds a stream fed through `bytesIn`, before any thread runs. Shares
+  // start out equal.
+  Share &join(const StatCounter &bytesIn) {
+    shares_.push_back(std::make_unique<Share>());
+    shares_.back()->bytesIn = &bytesIn;
+    size_t equal = std::min(maxWindow_, budget_ / shares_.size());
+    for (auto &share : shares_) {
+      share->limit.store(equal, std::memory_order_relaxed);
+    }
+    // Smallest move of a limit that is worth resizing a window for
+    quantum_ = std::max<size_t>(4096, budget_ / (64 * shares_.size()));
+    return *shares_.back();
+  }
+
+  // When the next rebalance() is due
+  std::chrono::steady_clock::time_point nextRebalance() const {
+    return std::chrono::steady_clock::time_point(
+        std::chrono::steady_clock::duration(
+            next_.load(std::memory_order_relaxed)));
+  }
+
+  // Any writer thread: recomputes every share once per interval. A no-op
+  // before then, or while another writer thread is at it.
+  void rebalance(std::chrono::steady_clock::time_point now) {
+    if (now < nextRebalance()) {
+      return;
+    }
+    std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+    if (!lock || now < nextRebalance()) {
+      return;
+    }
+    next_.store((now + kInterval).time_since_epoch().count(),
+                std::memory_order_relaxed);
+
+    size_t n = shares_.size();
+    for (auto &share : shares_) {
+      uint64_t bytes = share->bytesIn->get();
+      share->rate = 0.5 * share->rate +
+                    0.5 * static_cast<double>(bytes - share->lastBytes);
+      share->lastBytes = bytes;
+    }
+
+    // Water-filling: shares that reach maxWindow_ are fixed there and the
+    // rest of the spare bytes are split again among the others. The +1
+    // splits evenly between streams that are all idle.
+    std::vector<size_t> limits(n, 0);
+    double spare = static_cast<double>(budget_ - minWindow_ * n);
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      double weights = 0;
+      for (size_t i = 0; i < n; ++i) {
+        weights += limits[i] == 0 ? shares_[i]->rate + 1 : 0;
+      }
+      for (size_t i = 0; i < n && weights > 0; ++i) {
+        double extra = spare * (shares_[i]->rate + 1) / weights;
+        if (limits[i] == 0 &&
+            static_cast<double>(minWindow_) + extra >=
+                static_cast<double>(maxWindow_)) {
+          limits[i] = maxWindow_;
+          spare -= static_cast<double>(maxWindow_ - minWindow_);
+          changed = true;
+        }
+      }
+      if (!changed) {
+        for (size_t i = 0; i < n && weights > 0; ++i) {
+          if (limits[i] == 0) {
+            limits[i] = minWindow_ + static_cast<size_t>(
+                                         spare * (shares_[i]->rate + 1) /
+                                         weights);
+          }
+        }
+      }
+    }
+    applyHysteresis(limits);
+    for (size_t i = 0; i < n; ++i) {
+      shares_[i]->limit.store(limits[i], std::memory_order_relaxed);
+    }
+  }
+
+private:
+  // Turns the exact `targets` into the limits to apply. A share keeps its
+  // current limit while its target is less than a quantum away. Kept
+  // limits above target then give way, largest excess first, until the
+  // total fits the budget, and kept limits below target take their target
+  // while the bytes are free, largest shortfall first.
+  void applyHysteresis(std::vector<size_t> &targets) const {
+    size_t n = shares_.size();
+    std::vector<size_t> limits(n);
+    size_t total = 0;
+    for (size_t i = 0; i < n; ++i) {
+      size_t current = shares_[i]->limit.load(std::memory_order_relaxed);
+      size_t distance = current > targets[i] ? current - targets[i]
+                                             : targets[i] - current;
+      limits[i] = distance < quantum_ ? current : targets[i];
+      total += limits[i];
+    }
+    auto gap = [&](size_t i) {
+      return static_cast<int64_t>(limits[i]) -
+             static_cast<int64_t>(targets[i]);
+    };
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; ++i) {
+      order[i] = i;
+    }
+    std::sort(order.begin(), order.end(),
+              [&](size_t a, size_t b) { return gap(a) > gap(b); });
+    for (size_t i : order) {
+      if (total > budget_ && gap(i) > 0) {
+        total -= limits[i] - targets[i];
+        limits[i] = targets[i];
+      }
+    }
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+      size_t i = *it;
+      if (gap(i) < 0 && total + (targets[i] - limits[i]) <= budget_) {
+        total += targets[i] - limits[i];
+        limits[i] = targets[i];
+      }
+    }
+    targets.swap(limits);
+  }
+
+  size_t budget_;
+  size_t minWindow_;
+  size_t maxWindow_;
+  size_t quantum_ = 4096;
+  std::vector<std::unique_ptr<Share>> shares_; // Fixed once threads run
+  std::mutex mutex_;
+  std::atomic<std::chrono::steady_clock::rep> next_{0};
+};
+
+// ============================================================================
+// FlushPolicy: Decides when the writer flushes its window
+// ============================================================================
+
+// Triggers combine: the window is flushed as soon as any enabled one fires.
+//   interval    --write-interval since the previous flush (the default)
+//   idle        input has been quiet for --flush-idle (replaces interval)
+//   bytes       --flush-bytes of new input are pending
+//   max latency the oldest pending line has waited --max-latency
+// With --adaptive-flush, the interval doubles (up to the latency bound)
+// while the whole window turns over between flushes, and halves back once
+// the input rate drops.
+class FlushPolicy {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit FlushPolicy(const Config &config)
+      : immediate_(config.immediate), base_(config.writeInterval),
+        interval_(config.writeInterval), idle_(config.flushIdle),
+        maxLatency_(config.maxLatency), flushBytes_(config.flushBytes),
+        windowSize_(config.maxSize), adaptive_(config.adaptiveFlush),
+        lastFlush_(Clock::now()) {
+    if (idle_.count() > 0 && maxLatency_.count() == 0) {
+      maxLatency_ = base_; // A steady trickle must not postpone flushes forever
+    }
+    maxInterval_ = maxLatency_.count() > 0 ? maxLatency_ : 8 * base_;
+  }
+
+  void onInput(size_t bytes, Clock::time_point now) {
+    if (pending_ == 0) {
+      firstInput_ = now;
+    }
+    pending_ += bytes;
+    lastInput_ = now;
+  }
+
+  bool due(Clock::time_point now) const {
+    if (pending_ == 0) {
+      return false;
+    }
+    return immediate_ || (flushBytes_ > 0 && pending_ >= flushBytes_) ||
+           now >= nextDeadline();
+  }
+
+  // When due() becomes true without further input (max() if it never does)
+  Clock::time_point nextDeadline() const {
+    if (pending_ == 0) {
+      return Clock::time_point::max();
+    }
+    Clock::time_point deadline =
+        idle_.count() > 0 ? lastInput_ + idle_ : lastFlush_ + interval_;
+    if (maxLatency_.count() > 0) {
+      deadline = std::min(deadline, firstInput_ + maxLatency_);
+    }
+    return deadline;
+  }
+
+  void onFlush(Clock::time_point now) {
+    if (adaptive_) {
+      if (pending_ >= windowSize_) {
+        // Lines are overwritten before they could be read: write less often
+        interval_ = std::min(2 * interval_, maxInterval_);
+      } else if (pending_ < windowSize_ / 4) {
+        interval_ = std::max(interval_ / 2, base_);
+      }
+    }
+    pending_ = 0;
+    lastFlush_ = now;
+  }
+
+private:
+  bool immediate_;
+  std::chrono::milliseconds base_;
+  std::chrono::milliseconds interval_; // Current interval (adaptive)
+  std::chrono::milliseconds maxInterval_{0};
+  std::chrono::milliseconds idle_;
+  std::chrono::milliseconds maxLatency_;
+  size_t flushBytes_;
+  size_t windowSize_;
+  bool adaptive_;
+  size_t pending_ = 0; // Bytes received since the last flush
+  Clock::time_point firstInput_;
+  Clock::time_point lastInput_;
+  Clock::time_point lastFlush_;
+};
+
+// ============================================================================
+// LineFilter: Include/exclude patterns and per-pattern sampling (--include...)
+// ============================================================================
+//
+// Runs on the reader thread between line framing and the hand-off, so a
+// filtered line never costs queue space, a copy or a flush. Literal
+// patterns go first: string_view::find is memchr-driven, which libc
+// vectorizes. std::regex only runs on lines the literals did not settle.
+// Evaluation: any exclude match drops the line; with include patterns
+// present, a line must match one of them; then the first sample or rate
+// rule whose text the line contains decides whether it is kept.
+
+class LineFilter {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit LineFilter(const std::vector<FilterSpec> &specs) {
+    for (const FilterSpec &spec : specs) {
+      switch (spec.kind) {
+      case FilterKind::Include:
+        includes_.push_back(spec.pattern);
+        break;
+      case FilterKind::Exclude:
+        excludes_.push_back(spec.pattern);
+        break;
+      case FilterKind::IncludeRegex:
+        includeRegex_.emplace_back(spec.pattern, kRegexFlags);
+        break;
+      case FilterKind::ExcludeRegex:
+        excludeRegex_.emplace_back(spec.pattern, kRegexFlags);
+        break;
+      case FilterKind::Sample:
+      case FilterKind::RateLimit:
+        throttles_.push_back(
+            {spec.pattern, spec.limit, spec.kind == FilterKind::RateLimit});
+        break;
+      }
+    }
+  }
+
+  bool active() const {
+    return !includes_.empty() || !excludes_.empty() ||
+           !includeRegex_.empty() || !excludeRegex_.empty() ||
+           !throttles_.empty();
+  }
+
+  // Rate limits need the time; the caller reads the clock once per chunk
+  bool needsClock() const {
+    return std::any_of(throttles_.begin(), throttles_.end(),
+                       [](const Throttle &t) { return t.perSecond; });
+  }
+
+  bool keep(std::string_view line, Clock::time_point now) {
+    if (!matches(line)) {
+      return false;
+    }
+    int throttle = throttleFor(line);
+    return throttle < 0 || admit(throttle, now);
+  }
+
+  // The stateless part of keep(): exclude and include patterns. Safe to
+  // call from several threads at once.
+  bool matches(std::string_view line) const {
+    for (const std::string &pattern : excludes_) {
+      if (line.find(pattern) != std::string_view::npos) {
+        return false;
+      }
+    }
+    for (const std::regex &re : excludeRegex_) {
+      if (std::regex_search(line.begin(), line.end(), re)) {
+        return false;
+      }
+    }
+    if (!includes_.empty() || !includeRegex_.empty()) {
+      bool matched = std::any_of(
+          includes_.begin(), includes_.end(), [&](const std::string &p) {
+            return line.find(p) != std::string_view::npos;
+          });
+      if (!matched) {
+        matched = std::any_of(
+            includeRegex_.begin(), includeRegex_.end(),
+            [&](const std::regex &re) {
+              return std::regex_search(line.begin(), line.end(), re);
+            });
+      }
+      if (!matched) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Index of the first sample/rate rule whose text `line` contains, or -1.
+  // Also thread-safe.
+  int throttleFor(std::string_view line) const {
+    for (size_t i = 0; i < throttles_.size(); ++i) {
+      if (line.find(throttles_[i].pattern) != std::string_view::npos) {
+        return static_cast<int>(i);
+      }
+    }
+    return -1;
+  }
+
+  // The stateful part: counts a line against rule `throttle`. One caller at
+  // a time, in line order.
+  bool admit(int throttle, Clock::time_point now) {
+    return throttles_[static_cast<size_t>(throttle)].admit(now);
+  }
+
+private:
+  static constexpr auto kRegexFlags =
+      std::regex::ECMAScript | std::regex::optimize;
+
+  struct Throttle {
+    std::string pattern;
+    uint64_t limit;
+    bool perSecond; // Rate limit; otherwise 1-in-limit sampling
+    uint64_t seen = 0;
+    Clock::time_point windowStart{};
+
+    bool admit(Clock::time_point now) {
+      if (!perSecond) {
+        return seen++ % limit == 0;
+      }
+      if (now - windowStart >= std::chrono::seconds(1)) {
+        windowStart = now;
+        seen = 0;
+      }
+      return seen++ < limit;
+    }
+  };
+
+  std::vector<std::string> includes_;
+  std::vector<std::string> excludes_;
+  std::vector<std::regex> includeRegex_;
+  std::vector<std::regex> excludeRegex_;
+  std::vector<Throttle> throttles_;
+};
+
+// ============================================================================
+// Waker: Sleep/wake handshake between producers and one writer thread
+// ============================================================================
+
+class Waker {
+public:
+  // The mutex only guards the writer's transition to sleep; producers take
+  // it just to deliver a wake-up, never while I/O is in progress.
+  void wake() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping_.load(std::memory_order_relaxed)) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      cv_.notify_one();
+    }
+  }
+
+  // Sleeps until woken or `deadline`. `ready` is re-checked after announcing
+  // the sleep, so work published just before then is never slept through.
+  template <typename Ready>
+  void sleepUntil(std::chrono::steady_clock::time_point deadline,
+                  Ready ready) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    sleeping_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!ready()) {
+      if (deadline == std::chrono::steady_clock::time_point::max()) {
+        cv_.wait(lock);
+      } else {
+        cv_.wait_until(lock, deadline);
+      }
+    }
+    sleeping_.store(false, std::memory_order_relaxed);
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::atomic<bool> sleeping_{false};
+};
+
+// ============================================================================
+// WindowServer: The live window over a unix or loopback TCP socket (--serve)
+// ============================================================================
+//
+// A client gets the window as it stands when it connects, then every line
+// that enters the window afterwards, so it never has to poll the log file.
+// The writer thread only appends to per-client queues under a short lock;
+// a server thread does all socket I/O, so a client can never stall the
+// writer or the reader. A client whose backlog outgrows its queue limit is
+// disconnected (rather than sent a stream with gaps) and may reconnect for
+// a fresh snapshot. Anything a client sends is ignored.
+
+#if POSIX_AVAILABLE
+
+class WindowServer {
+public:
+  explicit WindowServer(size_t maxSize)
+      : queueLimit_(std::max(2 * maxSize, kMinQueueLimit)) {}
+
+  ~WindowServer() { stop(); }
+
+  WindowServer(const WindowServer &) = delete;
+  WindowServer &operator=(const WindowServer &) = delete;
+
+  // Binds unix:<path> or tcp:<port>; reports failures itself
+  bool listen(const std::string &address) {
+    if (address.rfind("unix:", 0) == 0) {
+      unixPath_ = address.substr(5);
+      listenFd_ = listenUnixSocket(unixPath_);
+    } else {
+      unsigned long port = 0;
+      try {
+        port = std::stoul(address.substr(4));
+      } catch (...) {
+        port = 0;
+      }
+      if (port == 0 || port > 65535) {
+        std::cerr << "Error: Invalid --serve port: " << address << '\n';
+        return false;
+      }
+      listenFd_ = listenTcpLoopback(static_cast<uint16_t>(port));
+    }
+    if (listenFd_ < 0 || ::pipe(wakePipe_) != 0 ||
+        fcntl(wakePipe_[0], F_SETFL, O_NONBLOCK) != 0 ||
+        fcntl(wakePipe_[1], F_SETFL, O_NONBLOCK) != 0) {
+      std::cerr << "Error: Failed to listen on " << address << ": "
+                << std::strerror(errno) << '\n';
+      return false;
+    }
+    return true;
+  }
+
+  // Starts serving; `waker` belongs to the thread that owns the window
+  void start(Waker &waker) {
+    waker_ = &waker;
+    thread_ = std::thread([this]() { run(); });
+  }
+
+  // Sends what is still queued (as far as the sockets accept it without
+  // blocking) and closes every connection
+  void stop() {
+    if (thread_.joinable()) {
+      stopping_.store(true, std::memory_order_release);
+      notify();
+      thread_.join();
+    }
+    for (auto &client : clients_) {
+      ::close(client->fd);
+    }
+    clients_.clear();
+    for (int &fd : {std::ref(listenFd_), std::ref(wakePipe_[0]),
+                    std::ref(wakePipe_[1])}) {
+      if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+      }
+    }
+    if (!unixPath_.empty()) {
+      ::unlink(unixPath_.c_str());
+      unixPath_.clear();
+    }
+  }
+
+  // True while accepted clients still wait for their snapshot
+  bool hasJoiners() const { return joiners_.load(std::memory_order_acquire); }
+
+  // Writer thread: queues the whole window, followed by `partial` (bytes
+  // of an unfinished line already taken from the input), for every client
+  // accepted since the last call. Bytes published later continue it.
+  void attach(const LineBuffer &window, std::string_view partial) {
+    LineBuffer::Segment segs[2];
+    size_t count = window.segments(segs);
+    std::lock_guard<std::mutex> lock(mutex_);
+    joiners_.store(false, std::memory_order_relaxed);
+    for (auto &client : clients_) {
+      if (!client->attached) {
+        for (size_t i = 0; i < count; ++i) {
+          client->queued.append(segs[i].data, segs[i].size);
+        }
+        client->queued.append(partial);
+        client->attached = true;
+        ++attached_;
+      }
+    }
+    notify();
+  }
+
+  // Writer thread: queues input bytes, in arrival order, for every attached
+  // client. Lines are forwarded before the window trims them, so a client
+  // sees every line even when a burst turns the window over. Costs one
+  // atomic load while nobody is connected.
+  void publish(const std::string_view *pieces, size_t count) {
+    if (attached_.load(std::memory_order_relaxed) == 0) {
+      return;
+    }
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; ++i) {
+      bytes += pieces[i].size();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &client : clients_) {
+      if (!client->attached || client->dropped) {
+        continue;
+      }
+      if (client->queued.size() + client->unsent + bytes > queueLimit_) {
+        client->dropped = true; // Too slow; closed by the server thread
+        client->queued.clear();
+        continue;
+      }
+      for (size_t i = 0; i < count; ++i) {
+        client->queued.append(pieces[i]);
+      }
+    }
+    notify();
+  }
+
+private:
+  static constexpr size_t kMinQueueLimit = 1024 * 1024;
+
+  struct Client {
+    int fd;
+    bool attached = false; // Snapshot queued
+    bool dropped = false;  // Fell behind or hung up
+    std::string queued;    // Appended by the writer thread (under mutex_)
+    size_t unsent = 0;     // Bytes of `sending` not yet sent (under mutex_)
+    std::string sending;   // Server thread only
+    size_t sent = 0;
+  };
+
+  void notify() {
+    if (!notified_.exchange(true, std::memory_order_acq_rel)) {
+      char byte = 1;
+      (void)!::write(wakePipe_[1], &byte, 1);
+    }
+  }
+
+  void run() {
+    std::vector<struct pollfd> fds;
+    std::vector<Client *> polled;
+    while (true) {
+      bool stopping = stopping_.load(std::memory_order_acquire);
+      fds.assign({{listenFd_, POLLIN, 0}, {wakePipe_[0], POLLIN, 0}});
+      polled.clear();
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::erase_if(clients_, [this](const std::unique_ptr<Client> &c) {
+          if (c->dropped) {
+            ::close(c->fd);
+            attached_ -= c->attached;
+          }
+          return c->dropped;
+        });
+        for (auto &client : clients_) {
+          if (client->sent == client->sending.size() &&
+              !client->queued.empty()) {
+            client->sending.clear();
+            client->sending.swap(client->queued);
+            client->sent = 0;
+          }
+          client->unsent = client->sending.size() - client->sent;
+          short events = POLLIN;
+          if (client->unsent > 0) {
+            events |= POLLOUT;
+          }
+          fds.push_back({client->fd, events, 0});
+          polled.push_back(client.get());
+        }
+      }
+      if (stopping) {
+        // Final pass: push out what the sockets take without blocking
+        for (Client *client : polled) {
+          sendPending(*client);
+        }
+        return;
+      }
+
+      if (::poll(fds.data(), fds.size(), -1) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        std::cerr << "poll() error on --serve: " << std::strerror(errno)
+                  << '\n';
+        return;
+      }
+      if (fds[1].revents & POLLIN) {
+        char scratch[64];
+        while (::read(wakePipe_[0], scratch, sizeof(scratch)) > 0) {
+        }
+        notified_.store(false, std::memory_order_release);
+      }
+      if (fds[0].revents & POLLIN) {
+        acceptClients();
+      }
+      for (size_t i = 0; i < polled.size(); ++i) {
+        serviceClient(*polled[i], fds[i + 2].revents);
+      }
+    }
+  }
+
+  void acceptClients() {
+    bool accepted = false;
+    while (true) {
+      int fd = ::accept(listenFd_, nullptr, nullptr);
+      if (fd < 0) {
+        if (errno == EINTR || errno == ECONNABORTED) {
+          continue;
+        }
+        break;
+      }
+      (void)fcntl(fd, F_SETFD, FD_CLOEXEC);
+      (void)fcntl(fd, F_SETFL, O_NONBLOCK);
+      auto client = std::make_unique<Client>();
+      client->fd = fd;
+      std::lock_guard<std::mutex> lock(mutex_);
+      clients_.push_back(std::move(client));
+      accepted = true;
+    }
+    if (accepted) {
+      // The snapshot must come from the writer thread, which owns the window
+      joiners_.store(true, std::memory_order_seq_cst);
+      waker_->wake();
+    }
+  }
+
+  void serviceClient(Client &client, short revents) {
+    bool closed = (revents & (POLLERR | POLLNVAL)) != 0;
+    if (!closed && (revents & (POLLIN | POLLHUP))) {
+      char scratch[4096];
+      ssize_t n = ::read(client.fd, scratch, sizeof(scratch));
+      closed = n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR);
+    }
+    if (!closed && (revents & POLLOUT)) {
+      closed = !sendPending(client);
+    }
+    if (closed) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      client.dropped = true;
+    }
+  }
+
+  // Sends from `sending` until the socket would block; false on hang-up
+  bool sendPending(Client &client) {
+#ifdef MSG_NOSIGNAL
+    constexpr int kFlags = MSG_NOSIGNAL; // A vanished client must not SIGPIPE
+#else
+    constexpr int kFlags = 0;
+#endif
+    while (client.sent < client.sending.size()) {
+      ssize_t n = ::send(client.fd, client.sending.data() + client.sent,
+                         client.sending.size() - client.sent, kFlags);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+      }
+      client.sent += static_cast<size_t>(n);
+    }
+    return true;
+  }
+
+  size_t queueLimit_;
+  int listenFd_ = -1;
+  int wakePipe_[2] = {-1, -1};
+  std::string unixPath_;
+  Waker *waker_ = nullptr;
+  std::thread thread_;
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<Client>> clients_; // Guarded by mutex_
+  std::atomic<size_t> attached_{0};
+  std::atomic<bool> joiners_{false};
+  std::atomic<bool> notified_{false};
+  std::atomic<bool> stopping_{false};
+};
+
+#endif // POSIX_AVAILABLE
+
+// ============================================================================
+// SyncScheduler: Batched fdatasync with group commit (--durability)
+// ============================================================================
+//
+// Flushes make lines visible; this makes them durable, on its own thread and
+// cadence so a slow disk never holds up a flush. Each writer keeps one entry
+// per file (`key`): committing again before the sync ran replaces the entry,
+// so a file is synced once per round however often it was flushed. Rounds
+// run every --sync-interval, or (always) as soon as something is pending; a
+// writer that commits while a round is running joins the next one, so
+// concurrent writers in multi-input mode share one round: group commit.
+
+#if POSIX_AVAILABLE
+
+class SyncScheduler {
+public:
+  SyncScheduler(Durability mode, std::chrono::milliseconds interval)
+      : mode_(mode), interval_(interval) {}
+
+  ~SyncScheduler() { stop(); }
+
+  SyncScheduler(const SyncScheduler &) = delete;
+  SyncScheduler &operator=(const SyncScheduler &) = delete;
+
+  bool active() const { return mode_ != Durability::None; }
+
+  bool always() const { return mode_ == Durability::Always; }
+
+  void start() {
+    if (active() && !thread_.joinable()) {
+      running_ = true;
+      thread_ = std::thread([this]() { run(); });
+    }
+  }
+
+  // Runs a last round for everything still pending and stops the thread
+  void stop() {
+    if (thread_.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+      }
+      pendingCv_.notify_all();
+      thread_.join();
+    }
+  }
+
+  // Writer thread: `fd` holds flushed data that should reach the disk. With
+  // `owned` the scheduler closes it once synced (or superseded). Always mode
+  // waits for the round that covers it and returns false if that round had
+  // a failure. Once stopped, syncs `fd` right away.
+  bool commit(const void *key, int fd, bool owned = false) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!running_) {
+      lock.unlock();
+      release(key);
+      return sync({key, fd, owned});
+    }
+    auto it = std::find_if(pending_.begin(), pending_.end(),
+                           [key](const Entry &e) { return e.key == key; });
+    if (it == pending_.end()) {
+      pending_.push_back({key, fd, owned});
+    } else {
+      if (it->owned && it->fd != fd) {
+        ::close(it->fd); // Superseded before it was synced
+      }
+      *it = {key, fd, owned};
+    }
+    if (!always()) {
+      return true;
+    }
+    uint64_t round = started_ + 1; // The next round takes this entry
+    pendingCv_.notify_one();
+    doneCv_.wait(lock, [&]() { return completed_ >= round; });
+    return !failed_;
+  }
+
+  // Writer thread: `key`'s file is about to be closed. Syncs it first if
+  // it is still pending, and waits out a round that might be using it.
+  void release(const void *key) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    doneCv_.wait(lock, [this]() { return completed_ == started_; });
+    auto it = std::find_if(pending_.begin(), pending_.end(),
+                           [key](const Entry &e) { return e.key == key; });
+    if (it == pending_.end()) {
+      return;
+    }
+    Entry entry = *it;
+    pending_.erase(it);
+    lock.unlock();
+    sync(entry);
+  }
+
+private:
+  struct Entry {
+    const void *key;
+    int fd;
+    bool owned;
+  };
+
+  void run() {
+    std::vector<Entry> batch;
+    auto next = std::chrono::steady_clock::now() + interval_;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      if (always()) {
+        pendingCv_.wait(lock,
+                        [this]() { return stopping_ || !pending_.empty(); });
+      } else {
+        pendingCv_.wait_until(lock, next, [this]() { return stopping_; });
+        next = std::max(next + interval_, std::chrono::steady_clock::now());
+      }
+      bool stopping = stopping_;
+      if (pending_.empty() && !stopping) {
+        continue;
+      }
+      batch.swap(pending_);
+      uint64_t round = ++started_;
+      lock.unlock();
+
+      bool ok = true;
+      for (const Entry &entry : batch) {
+        ok = sync(entry) && ok;
+      }
+      batch.clear();
+
+      lock.lock();
+      completed_ = round;
+      failed_ = !ok;
+      if (stopping) {
+        running_ = false;
+      }
+      doneCv_.notify_all();
+      if (stopping) {
+        return;
+      }
+    }
+  }
+
+  bool sync(const Entry &entry) {
+    bool ok = syncData(entry.fd) == 0;
+    if (!ok) {
+      reportError();
+    }
+    if (entry.owned) {
+      ::close(entry.fd);
+    }
+    return ok;
+  }
+
+  void reportError() {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(errorMutex_);
+    if (now - lastErrorTime_ >= std::chrono::seconds(2)) {
+      std::cerr << "Error: fdatasync failed (" << std::strerror(errno)
+                << ")\n";
+      lastErrorTime_ = now;
+    }
+  }
+
+  Durability mode_;
+  std::chrono::milliseconds interval_;
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable pendingCv_; // Something to sync, or stopping
+  std::condition_variable doneCv_;    // A round completed
+  std::vector<Entry> pending_;        // Guarded by mutex_
+  uint64_t started_ = 0;              // Rounds taken from pending_
+  uint64_t completed_ = 0;
+  bool failed_ = false; // Whether the last completed round had an error
+  bool running_ = false; // Rounds are run by thread_ (else inline)
+  bool stopping_ = false;
+  std::mutex errorMutex_;
+  std::chrono::steady_clock::time_point lastErrorTime_{};
+};
+
+#endif // POSIX_AVAILABLE
+
+// ============================================================================
+// Writer: Lock-free hand-off to a writer thread with time-driven flushes
+// ============================================================================
+
+class Writer {
+public:
+  Writer(const Config &config, Waker &waker)
+      : config_(config), waker_(waker), policy_(config),
+        filter_(config.filters),
+        atomicWrites_(config.atomicWrites),
+        incremental_(config.incremental),
+        collapse_(config.trimStrategy == TrimStrategy::Collapse),
+#if POSIX_AVAILABLE
+        mapped_(config), notifier_(config),
+        buffer_(windowCapacity(config), mapped_.data()),
+#else
+        buffer_(windowCapacity(config)),
+#endif
+        queue_(LineQueue::capacityFor(windowCapacity(config))),
+        chunks_(config), index_(config), history_(config) {
+    if (chunks_.active() && !chunks_.reset()) {
+      std::cerr << "Error: Failed to create " << config.logFile
+                << ".chunks: " << std::strerror(errno) << '\n';
+    }
+    if (history_.active()) {
+      if (!history_.open()) {
+        std::cerr << "Error: Failed to create " << config.logFile
+                  << ".history: " << std::strerror(errno) << '\n';
+      }
+      buffer_.spillTo(&evicted_);
+    }
+    if (config.maxTokens > 0) {
+      buffer_.trackTokens();
+    }
+    splitSegment_ = selectSplitter(config.collapseRepeats, chunks_.active(),
+                                   config.maxTokens > 0);
+    limit_ = config.memoryBudget > 0 ? windowCapacity(config) : config.maxSize;
+    resumed_ = config.resume && resumeWindow();
+#if IOURING_AVAILABLE
+    if (config.ioUring && !uring_.setup(8)) {
+      std::cerr << "Warning: io_uring unavailable (" << std::strerror(errno)
+                << "), using synchronous writes\n";
+      uring_.teardown();
+    }
+#endif
+    openFile();
+    if (resumed_) {
+      // Leave exactly the recovered window on disk before input arrives.
+      // A plain rewrite: the old file is not a window collapse can trim.
+      bool collapse = collapse_;
+      collapse_ = false;
+      flush(/*compact=*/true);
+      collapse_ = collapse;
+      resumed_ = false;
+    }
+  }
+
+  ~Writer() { closeFile(); }
+
+  // Queues a batch of lines (e.g. every complete line of one read()) for the
+  // writer thread, each preceded by `prefix` (--timestamps). Lock-free; only
+  // blocks if the queue is full.
+  void appendLines(std::span<const std::string_view> lines,
+                   std::string_view prefix = {}) {
+    if (lines.empty()) {
+      return;
+    }
+    for (std::string_view line : lines) {
+      if (!prefix.empty()) {
+        enqueue(prefix.data(), prefix.size());
+      }
+      enqueue(line.data(), line.size());
+      enqueue("\n", 1);
+    }
+    queue_.publish();
+    waker_.wake();
+  }
+
+  // Called on the owning writer thread: drains the queue into buffer_ and
+  // flushes if due, without holding any lock, so a slow disk never stalls the
+  // reader. Returns when the writer next needs servicing without new input.
+  std::chrono::steady_clock::time_point service() {
+#if POSIX_AVAILABLE
+    if (server_ && server_->hasJoiners()) {
+      server_->attach(buffer_, carry_);
+    }
+#endif
+    if (share_) {
+      applyShare();
+    }
+    drainQueue();
+    if (policy_.due(std::chrono::steady_clock::now())) {
+      flush();
+    }
+    spillHistory();
+    auto next = policy_.nextDeadline();
+    if (share_) {
+      next = std::min(next, budget_->nextRebalance());
+    }
+    if (!evicted_.empty()) {
+      next = std::min(next, spillDue_);
+    }
+    return next;
+  }
+
+  // True when service() has work: queued lines, or (--serve) clients
+  // waiting for a snapshot
+  bool needsService() const {
+#if POSIX_AVAILABLE
+    if (server_ && server_->hasJoiners()) {
+      return true;
+    }
+#endif
+    return !queue_.empty();
+  }
+
+#if POSIX_AVAILABLE
+  // Streams this window to `server`'s clients from now on. Call before
+  // input starts flowing.
+  void serve(WindowServer &server) {
+    server_ = &server;
+    server.start(waker_);
+  }
+
+  // Makes every flush durable through `sync` (--durability). Call before
+  // input starts flowing; a window already written (--resume) is included.
+  void syncWith(SyncScheduler &sync) {
+    sync_ = &sync;
+    if (fd_ >= 0) {
+      sync.commit(this, fd_);
+    }
+  }
+#endif
+
+  // Sizes this window by its share of `budget` (--memory-budget) from now
+  // on. Call before the writer threads start.
+  void shareBudget(MemoryBudget &budget) {
+    budget_ = &budget;
+    share_ = &budget.join(stats_.reader.bytesIn);
+  }
+
+  const std::string &logFile() const { return config_.logFile; }
+
+  // Reader-side counters are updated by the producer, the rest by the
+  // writer thread
+  StreamStats &stats() { return stats_; }
+
+  // Used (and its counters updated) by the reader thread only
+  LineFilter &filter() { return filter_; }
+
+  // Readers prefix every line with Timestamper::stamp() (--timestamps)
+  bool timestamps() const { return config_.timestamps; }
+
+  // Final flush on shutdown; leaves exactly the window on disk
+  void finish() {
+    drainQueue();
+    if (dirty_ || needsCompaction()) {
+      // A plain rewrite: collapse would leave up to a block of old lines
+      bool collapse = collapse_;
+      collapse_ = false;
+      flush(/*compact=*/true);
+      collapse_ = collapse;
+    }
+    completeIo();
+    spillHistory(/*force=*/true);
+  }
+
+private:
+  // With --compress, buffer_ holds only the open (newest) chunk
+  static size_t windowCapacity(const Config &config) {
+    if (config.memoryBudget > 0) {
+      return std::min(config.maxSize,
+                      config.memoryBudget / config.inputs.size());
+    }
+    return config.compress != Codec::None ? config.chunkSize : config.maxSize;
+  }
+
+  void enqueue(const char *data, size_t len) {
+    while (len > 0) {
+      size_t n = queue_.write(data, len);
+      data += n;
+      len -= n;
+      if (len > 0) {
+        queue_.publish();
+        waker_.wake();
+        auto start = std::chrono::steady_clock::now();
+        queue_.waitForSpace();
+        stats_.reader.queueStalls.add(1);
+        stats_.reader.queueWaitUs.add(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start)
+                .count()));
+      }
+    }
+  }
+
+  // Moves every queued line into buffer_. Lines are split again with memchr;
+  // only a line that wraps around the queue's end is copied via carry_.
+  void drainQueue() {
+    LineQueue::Segment segs[2];
+    size_t count = queue_.readable(segs);
+    if (count == 0) {
+      return;
+    }
+    completeIo(); // An in-flight write may still be reading buffer_
+#if POSIX_AVAILABLE
+    if (server_) {
+      std::string_view pieces[2];
+      for (size_t i = 0; i < count; ++i) {
+        pieces[i] = {segs[i].data, segs[i].size};
+      }
+      server_->publish(pieces, count);
+    }
+#endif
+
+#if POSIX_AVAILABLE
+    if (mapped_.active()) {
+      mapped_.beginUpdate();
+    }
+#endif
+    size_t total = 0;
+    size_t lines = 0;
+    size_t sealed = 0; // Lines moved from buffer_ into compressed chunks
+    size_t collapsed = 0; // Repeats folded into the newest line
+    size_t linesBefore = buffer_.lineCount();
+    uint64_t firstNew = buffer_.endOffset();
+    for (size_t i = 0; i < count; ++i) {
+      lines += (this->*splitSegment_)(segs[i], sealed, collapsed);
+      total += segs[i].size;
+    }
+    size_t evicted = 0;
+    if (chunks_.active()) {
+      evicted = chunks_.trim(config_.maxSize, buffer_.size());
+    } else {
+      buffer_.trimToMax(limit_);
+      if (config_.maxTokens > 0) {
+        buffer_.trimToTokens(config_.maxTokens);
+      }
+    }
+    evicted += linesBefore + lines - sealed - collapsed - buffer_.lineCount();
+    stats_.writer.linesEvicted.add(evicted);
+    stats_.writer.linesCollapsed.add(collapsed);
+    if (index_.active() && lines > 0) {
+      index_.stamp(firstNew);
+      index_.trim(buffer_.beginOffset());
+    }
+#if POSIX_AVAILABLE
+    if (mapped_.active()) {
+      mapped_.endUpdate(buffer_.beginOffset(), buffer_.endOffset());
+    }
+#endif
+
+    queue_.consume(total);
+    policy_.onInput(total, std::chrono::steady_clock::now());
+    dirty_ = true;
+    spillHistory();
+  }
+
+  // Writes the evicted lines staged in evicted_ to the history once a batch
+  // has built up or the oldest has waited HistoryLog::kMaxDelay, so the
+  // segments grow by large sequential appends
+  void spillHistory(bool force = false) {
+    if (evicted_.empty()) {
+      return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (spillDue_ == std::chrono::steady_clock::time_point{}) {
+      spillDue_ = now + HistoryLog::kMaxDelay;
+    }
+    if (!force && evicted_.size() < HistoryLog::kBatchSize &&
+        now < spillDue_) {
+      return;
+    }
+    if (!history_.append(evicted_)) {
+      reportError("Failed to write history segment");
+    }
+    evicted_.clear();
+    spillDue_ = {};
+  }
+
+  using SegmentSplitter = size_t (Writer::*)(const LineQueue::Segment &,
+                                             size_t &, size_t &);
+
+  // Picks the splitSegment specialization for the configured features, so
+  // the per-line loop carries no checks for features that are off
+  static SegmentSplitter selectSplitter(bool collapse, bool chunked,
+                                        bool tokens) {
+    static constexpr SegmentSplitter kSplitters[] = {
+        &Writer::splitSegment<false, false, false>,
+        &Writer::splitSegment<false, false, true>,
+        &Writer::splitSegment<false, true, false>,
+        &Writer::splitSegment<false, true, true>,
+        &Writer::splitSegment<true, false, false>,
+        &Writer::splitSegment<true, false, true>,
+        &Writer::splitSegment<true, true, false>,
+        &Writer::splitSegment<true, true, true>,
+    };
+    return kSplitters[(collapse ? 4 : 0) + (chunked ? 2 : 0) +
+                      (tokens ? 1 : 0)];
+  }
+
+  // Appends every complete line of one queue segment to the window and
+  // returns how many there were. An unterminated tail goes to carry_.
+  template <bool Collapse, bool Chunked, bool Tokens>
+  size_t splitSegment(const LineQueue::Segment &seg, size_t &sealed,
+                      size_t &collapsed) {
+    const char *data = seg.data;
+    const char *end = data + seg.size;
+    size_t lines = 0;
+    if (!carry_.empty()) {
+      // Only the first line can continue one that wrapped the queue's end
+      const char *nl =
+          static_cast<const char *>(std::memchr(data, '\n', seg.size));
+      if (!nl) {
+        carry_.append(data, seg.size);
+        return 0;
+      }
+      carry_.append(data, static_cast<size_t>(nl - data));
+      appendToWindow<Collapse, Chunked, Tokens>(carry_, sealed, collapsed);
+      carry_.clear();
+      ++lines;
+      data = nl + 1;
+    }
+    while (data < end) {
+      const char *nl = static_cast<const char *>(
+          std::memchr(data, '\n', static_cast<size_t>(end - data)));
+      if (!nl) {
+        carry_.append(data, static_cast<size_t>(end - data));
+        break;
+      }
+      appendToWindow<Collapse, Chunked, Tokens>(
+          std::string_view(data, static_cast<size_t>(nl - data)), sealed,
+          collapsed);
+      ++lines;
+      data = nl + 1;
+    }
+    return lines;
+  }
+
+  template <bool Collapse, bool Chunked, bool Tokens>
+  void appendToWindow(std::string_view line, size_t &sealed,
+                      size_t &collapsed) {
+    if constexpr (Collapse) {
+      if (collapseRepeat(line)) {
+        ++collapsed;
+        return;
+      }
+    }
+    size_t tokens = 0;
+    if constexpr (Tokens) {
+      tokens = estimateTokens(line);
+      if (tokens > config_.maxTokens) {
+        return; // Could never fit; counted as evicted
+      }
+    }
+    if (Chunked && buffer_.size() + line.size() + 1 > buffer_.capacity()) {
+      sealed += sealChunk();
+      if (line.size() + 1 > buffer_.capacity()) {
+        // Longer than a chunk: becomes a chunk of its own
+        std::string whole(line);
+        whole += '\n';
+        if (!chunks_.seal(whole, 1)) {
+          reportError("Failed to write compressed chunk");
+        }
+        ++sealed;
+        return;
+      }
+    }
+    buffer_.appendLine(line, tokens);
+    if constexpr (Collapse) {
+      repeatStart_ = buffer_.endOffset() - line.size() - 1;
+      repeatLen_ = line.size();
+      repeatCount_ = 1;
+    }
+  }
+
+  // Folds `line` into the newest buffered line when it repeats it. The
+  // length check rejects almost every other line before any byte compare,
+  // and a repeat is compared against the ring in place, so no copy of the
+  // previous line is kept. The counter suffix is rewritten in place and no
+  // new line entry is added.
+  bool collapseRepeat(std::string_view line) {
+    size_t lines = buffer_.lineCount();
+    if (repeatCount_ == 0 || lines == 0 ||
+        buffer_.lineStart(lines - 1) != repeatStart_) {
+      return false; // The newest line was sealed or is not tracked
+    }
+    if (line.size() != repeatLen_ || !buffer_.matches(repeatStart_, line)) {
+      return false;
+    }
+    uint64_t textEnd = repeatStart_ + repeatLen_;
+
+    char suffix[48] = " (repeated ";
+    size_t len = std::strlen(suffix);
+    auto [end, ec] =
+        std::to_chars(suffix + len, suffix + sizeof(suffix), repeatCount_ + 1);
+    (void)ec;
+    std::memcpy(end, " times)", 7);
+    len = static_cast<size_t>(end - suffix) + 7;
+    size_t tokens = 0;
+    if (config_.maxTokens > 0) {
+      tokens = estimateTokens(line) + estimateTokens({suffix, len}) - 1;
+    }
+    if (!buffer_.rewriteNewestLine(textEnd, {suffix, len}, tokens)) {
+      return false;
+    }
+    ++repeatCount_;
+    noteRewrite(textEnd);
+    return true;
+  }
+
+  // The bytes from logical offset `from` on changed after they may have
+  // been written out: incremental flushes append from there again
+  void noteRewrite(uint64_t from) {
+    rewrittenFrom_ = std::min(rewrittenFrom_, from);
+#if POSIX_AVAILABLE
+    fileEnd_ = std::min(fileEnd_, from);
+#endif
+  }
+
+  // Follows this stream's current share of the memory budget. The ring is
+  // reallocated at the new size, so a shrinking window returns its memory;
+  // lines it no longer holds are evicted and the file follows at once.
+  void applyShare() {
+    budget_->rebalance(std::chrono::steady_clock::now());
+    size_t target = share_->limit.load(std::memory_order_relaxed);
+    if (target == limit_) {
+      return;
+    }
+    completeIo(); // An in-flight write may still be reading buffer_
+    size_t lines = buffer_.lineCount();
+    buffer_.resize(target);
+    limit_ = target;
+    if (buffer_.lineCount() != lines) {
+      stats_.writer.linesEvicted.add(lines - buffer_.lineCount());
+      index_.trim(buffer_.beginOffset());
+      flush();
+      spillHistory();
+    }
+  }
+
+  // Compresses the open chunk into the chunk store and starts a new one.
+  // Returns how many lines left buffer_.
+  size_t sealChunk() {
+    size_t lines = buffer_.lineCount();
+    if (lines == 0) {
+      return 0;
+    }
+    buffer_.assemble(sealScratch_);
+    if (!chunks_.seal(sealScratch_, lines)) {
+      reportError("Failed to write compressed chunk");
+    }
+    buffer_.clear();
+    return lines;
+  }
+
+  // Appends the whole lines of `tail` that fit the window to buffer_.
+  // Returns false if there were none.
+  bool seedWindow(const LogTail &tail) {
+    std::string_view text = tailLines(tail.text, limit_);
+    while (!text.empty()) {
+      size_t nl = text.find('\n');
+      std::string_view line = text.substr(0, nl);
+      buffer_.appendLine(line,
+                         config_.maxTokens > 0 ? estimateTokens(line) : 0);
+      text.remove_prefix(nl == std::string_view::npos ? text.size() : nl + 1);
+    }
+    // An unterminated last line gained a newline and may not fit otherwise
+    buffer_.trimToMax(limit_);
+    if (config_.maxTokens > 0) {
+      buffer_.trimToTokens(config_.maxTokens);
+    }
+    if (buffer_.empty()) {
+      return false;
+    }
+    index_.stamp(buffer_.beginOffset(), tail.mtimeUs);
+    return true;
+  }
+
+#if POSIX_AVAILABLE
+  // --resume: seeds buffer_ from the end of the existing log file, so a
+  // restart keeps the context readers were looking at. Only the last
+  // maxSize + 1 bytes are mapped and touched, however large the file is.
+  bool resumeWindow() {
+    int fd = ::open(config_.logFile.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      if (errno != ENOENT) {
+        reportError("Failed to open log file for --resume");
+      }
+      return false;
+    }
+    bool seeded = false;
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+      size_t size = static_cast<size_t>(st.st_size);
+      size_t keep = std::min(size, limit_ + 1);
+      size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+      size_t from = size - keep;
+      size_t mapFrom = from / page * page;
+      void *map = ::mmap(nullptr, size - mapFrom, PROT_READ, MAP_PRIVATE, fd,
+                         static_cast<off_t>(mapFrom));
+      if (map == MAP_FAILED) {
+        reportError("Failed to map log file for --resume");
+      } else {
+        LogTail tail;
+        tail.text = {static_cast<const char *>(map) + (from - mapFrom), keep};
+        tail.mtimeUs = static_cast<int64_t>(st.st_mtime) * 1000000;
+        seeded = seedWindow(tail);
+        ::munmap(map, size - mapFrom);
+      }
+    }
+    ::close(fd);
+    return seeded;
+  }
+#else
+  // --resume: seeds buffer_ from the end of the existing log file, reading
+  // only its last maxSize + 1 bytes
+  bool resumeWindow() {
+    std::ifstream file(config_.logFile, std::ios::binary | std::ios::ate);
+    std::streamoff size = file ? static_cast<std::streamoff>(file.tellg()) : 0;
+    if (size <= 0) {
+      return false;
+    }
+    size_t keep = std::min(static_cast<size_t>(size), limit_ + 1);
+    std::string text(keep, '\0');
+    file.seekg(size - static_cast<std::streamoff>(keep));
+    file.read(text.data(), static_cast<std::streamsize>(keep));
+    if (!file) {
+      reportError("Failed to read log file for --resume");
+      return false;
+    }
+    LogTail tail;
+    tail.text = text;
+    tail.mtimeUs = coarseMicros();
+    return seedWindow(tail);
+  }
+#endif
+
+  void createParentDirectory() {
+    std::error_code ec;
+    auto parent = std::filesystem::path(config_.logFile).parent_path();
     if (!parent.empty()) {
       std::filesystem::create_directories(parent, ec);
     }
+  }
+
+#if POSIX_AVAILABLE
+  void openFile() {
+    if (atomicWrites_ || mapped_.active()) {
+      // Atomic writes don't keep file open; the mapping owns its own
+      return;
+    }
+
+    createParentDirectory();
+    // A resumed window replaces the old contents with its first flush
+    int truncate = resumed_ ? 0 : O_TRUNC;
+    fd_ = ::open(config_.logFile.c_str(),
+                 O_RDWR | O_CREAT | truncate | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+      reportError("Failed to open log file");
+    }
+    fileStart_ = fileEnd_ = buffer_.beginOffset();
+
+    struct stat st;
+    if (fd_ >= 0 && ::fstat(fd_, &st) == 0 && st.st_blksize > 0) {
+      blockSize_ = static_cast<size_t>(st.st_blksize);
+    }
+  }
+
+  // True when the file holds bytes that have already left the window, or
+  // (--mmap) is still laid out as a ring rather than plain text
+  bool needsCompaction() const {
+    return (incremental_ && fileStart_ != buffer_.beginOffset()) ||
+           mapped_.active();
+  }
+
+  void closeFile() {
+    completeIo();
+    if (sync_) {
+      sync_->release(this); // Also syncs what is still pending
+      sync_->release(&dirFd_);
+    }
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+    if (dirFd_ >= 0) {
+      ::close(dirFd_);
+      dirFd_ = -1;
+    }
+  }
+
+#if IOURING_AVAILABLE
+  // Queues `iov` as a write at `offset`, linked to an ftruncate to `size`
+  // when `truncate` is set, and returns without waiting. The kernel reads
+  // straight from buffer_, so completeIo() must run before it changes.
+  // With --durability always an fdatasync ends the chain, so the flush is
+  // made durable without the writer thread waiting on it.
+  bool submitWrite(const struct iovec *iov, int count, off_t offset,
+                   bool truncate, off_t size) {
+    if (!uring_.active()) {
+      return false;
+    }
+    std::copy(iov, iov + count, uringIov_);
+    uringExpected_ = 0;
+    for (int i = 0; i < count; ++i) {
+      uringExpected_ += iov[i].iov_len;
+    }
+
+    io_uring_sqe *write = uring_.nextSqe();
+    write->opcode = IORING_OP_WRITEV;
+    write->fd = fd_;
+    write->addr = reinterpret_cast<uint64_t>(uringIov_);
+    write->len = static_cast<unsigned>(count);
+    write->off = static_cast<uint64_t>(offset);
+    write->user_data = kWriteOp;
+    inflight_ = 1;
+
+    io_uring_sqe *last = write;
+    truncateTo_ = truncate ? size : -1;
+    if (truncate && uringTruncate_) {
+      write->flags |= IOSQE_IO_LINK; // Truncate only after a full write
+      io_uring_sqe *trunc = uring_.nextSqe();
+      trunc->opcode = IoUring::kOpFtruncate;
+      trunc->fd = fd_;
+      trunc->off = static_cast<uint64_t>(size);
+      trunc->user_data = kTruncateOp;
+      last = trunc;
+      ++inflight_;
+    }
+    // A truncate owed synchronously would land after the sync: leave
+    // those flushes to the sync scheduler
+    syncLinked_ = sync_ && sync_->always() && !(truncate && !uringTruncate_);
+    if (syncLinked_) {
+      last->flags |= IOSQE_IO_LINK;
+      io_uring_sqe *sync = uring_.nextSqe();
+      sync->opcode = IORING_OP_FSYNC;
+      sync->fd = fd_;
+      sync->fsync_flags = IORING_FSYNC_DATASYNC;
+      sync->user_data = kSyncOp;
+      ++inflight_;
+    }
+
+    if (!uring_.submit()) {
+      reportError("io_uring submit failed, using synchronous writes");
+      uring_.teardown();
+      inflight_ = 0;
+      syncLinked_ = false;
+      return false;
+    }
+    return true;
+  }
+#endif
+
+  // True when the submitted flush chain makes itself durable (--io-uring)
+  bool syncLinked() const {
+#if IOURING_AVAILABLE
+    return syncLinked_;
+#else
+    return false;
+#endif
+  }
+
+  // Waits for the previously submitted flush chain, if any, to land
+  void completeIo() {
+#if IOURING_AVAILABLE
+    bool failed = false;
+    bool truncated = false;
+    bool synced = false;
+    while (inflight_ > 0) {
+      io_uring_cqe cqe;
+      if (!uring_.waitCqe(cqe)) {
+        failed = true;
+        break;
+      }
+      --inflight_;
+      if (cqe.user_data == kWriteOp &&
+          static_cast<size_t>(cqe.res) != uringExpected_) {
+        errno = cqe.res < 0 ? -cqe.res : EIO;
+        failed = true;
+      } else if (cqe.user_data == kTruncateOp) {
+        if (cqe.res == -EINVAL) {
+          uringTruncate_ = false; // Kernel predates IORING_OP_FTRUNCATE
+        } else if (cqe.res < 0 && cqe.res != -ECANCELED) {
+          errno = -cqe.res;
+          failed = true;
+        } else {
+          truncated = cqe.res == 0;
+        }
+      } else if (cqe.user_data == kSyncOp) {
+        if (cqe.res < 0 && cqe.res != -ECANCELED) {
+          errno = -cqe.res;
+          failed = true;
+        } else {
+          synced = cqe.res == 0;
+        }
+      }
+    }
+    inflight_ = 0;
+    bool syncOwed = syncLinked_ && !synced;
+    syncLinked_ = false;
+
+    if (failed) {
+      // Reopening truncates the file, so the next flush rewrites it whole
+      reportError("Failed to write to log file");
+      truncateTo_ = -1;
+      if (fd_ >= 0) {
+        if (sync_) {
+          sync_->release(this); // No round may sync the fd once it is closed
+        }
+        ::close(fd_);
+        fd_ = -1;
+      }
+      return;
+    }
+    if (truncateTo_ >= 0 && !truncated &&
+        ::ftruncate(fd_, truncateTo_) != 0) {
+      reportError("Failed to resize log file");
+    }
+    truncateTo_ = -1;
+    if (syncOwed && syncData(fd_) != 0) {
+      // The linked sync was cancelled, e.g. by an unsupported ftruncate
+      reportError("Failed to sync log file");
+    }
+#endif
+  }
+
+  void flush(bool compact = false) {
+    auto start = std::chrono::steady_clock::now();
+    completeIo();
+    if (mapped_.active()) {
+      bool ok = compact ? mapped_.linearize(buffer_) : mapped_.sync();
+      if (!ok) {
+        reportError("Failed to sync mapped log file");
+      }
+    } else if (atomicWrites_) {
+      struct iovec iov[2];
+      int count = windowIovec(buffer_.beginOffset(), iov);
+      flushAtomic(iov, count);
+    } else if (incremental_ && (!compact || collapse_)) {
+      flushIncremental(compact);
+    } else {
+      flushInPlace();
+    }
+    if (sync_ && fd_ >= 0 && !syncLinked()) {
+      if (sync_->always()) {
+        completeIo(); // The sync must cover this flush's write
+      }
+      if (fd_ >= 0) { // A failed io_uring write closes it
+        sync_->commit(this, fd_);
+      }
+    }
+    if (index_.active() || notifier_.active()) {
+      completeIo(); // Sidecars must not point past what reached the file
+      uint64_t fileStart = incremental_ ? fileStart_ : buffer_.beginOffset();
+      if (index_.active()) {
+        writeIndex(fileStart);
+      }
+      if (notifier_.active()) {
+        notifier_.publish(fileStart, buffer_.beginOffset(),
+                          buffer_.endOffset(), rewrittenFrom_);
+      }
+    }
+    rewrittenFrom_ = UINT64_MAX;
+
+    dirty_ = false;
+    auto now = std::chrono::steady_clock::now();
+    stats_.recordFlush(now - start);
+    policy_.onFlush(now);
+  }
+
+  // Points `iov` at the ring's bytes from logical offset `from` to the end,
+  // so the kernel reads straight out of the buffer with no copy.
+  int windowIovec(uint64_t from, struct iovec iov[2]) const {
+    LineBuffer::Segment segs[2];
+    size_t count = buffer_.segmentsFrom(from, segs);
+    for (size_t i = 0; i < count; ++i) {
+      iov[i].iov_base = const_cast<char *>(segs[i].data);
+      iov[i].iov_len = segs[i].size;
+    }
+    return static_cast<int>(count);
+  }
+
+  // Appends only the bytes added since the last flush. Once the file would
+  // outgrow compactSize (or on the final flush) the evicted head is dropped:
+  // in place with the collapse strategy, otherwise by rewriting the window.
+  // Lines evicted before ever reaching the disk always force a rewrite.
+  void flushIncremental(bool compact = false) {
+    if (fd_ < 0) {
+      openFile();
+      if (fd_ < 0) {
+        return; // Error already reported
+      }
+    }
+
+    if (fileEnd_ < buffer_.beginOffset()) {
+      flushInPlace();
+      return;
+    }
+
+    if (compact || buffer_.endOffset() - fileStart_ > config_.compactSize) {
+      if (!collapse_ || !collapseHead()) {
+        flushInPlace();
+        return;
+      }
+    }
+
+    struct iovec iov[2];
+    int count = windowIovec(fileEnd_, iov);
+    off_t offset = static_cast<off_t>(fileEnd_ - fileStart_);
+#if IOURING_AVAILABLE
+    if (submitWrite(iov, count, offset, /*truncate=*/false, 0)) {
+      fileEnd_ = buffer_.endOffset();
+      return;
+    }
+#endif
+    if (!writeFully(fd_, iov, count, offset)) {
+      reportError("Failed to append to log file");
+      closeFile();
+      return;
+    }
+    fileEnd_ = buffer_.endOffset();
+  }
+
+  // Removes the whole filesystem blocks in front of the window with
+  // FALLOC_FL_COLLAPSE_RANGE, so the kept lines are never rewritten. At most
+  // one block of older lines survives; if the cut lands mid-line, that
+  // fragment is blanked so the file still starts on a line boundary.
+  // Returns false (and disables collapsing) if the filesystem refuses.
+  bool collapseHead() {
+#if defined(__linux__) && defined(FALLOC_FL_COLLAPSE_RANGE)
+    uint64_t cut = buffer_.beginOffset() - fileStart_;
+    uint64_t aligned = cut / blockSize_ * blockSize_;
+    if (aligned == 0) {
+      return true;
+    }
+
+    // Bytes [aligned - 1, cut) tell us where the first surviving line starts
+    std::string head(static_cast<size_t>(cut - aligned + 1), '\0');
+    ssize_t n = ::pread(fd_, head.data(), head.size(),
+                        static_cast<off_t>(aligned - 1));
+    if (n != static_cast<ssize_t>(head.size())) {
+      reportError("Failed to read log file head");
+      return false;
+    }
+
+    if (::fallocate(fd_, FALLOC_FL_COLLAPSE_RANGE, 0,
+                    static_cast<off_t>(aligned)) != 0) {
+      reportError("Collapse trim unavailable, falling back to rewrite");
+      collapse_ = false;
+      return false;
+    }
+    fileStart_ += aligned;
+
+    size_t fragment = head.find('\n'); // Byte 0 is the one before the cut
+    if (fragment > 1) {
+      std::string blanks(fragment - 1, ' ');
+      if (::pwrite(fd_, blanks.data(), blanks.size(), 0) !=
+          static_cast<ssize_t>(blanks.size())) {
+        reportError("Failed to blank partial head line");
+      }
+    }
+    return true;
+#else
+    if (collapse_) {
+      reportError("Collapse trim requires Linux, falling back to rewrite");
+      collapse_ = false;
+    }
+    return false;
+#endif
+  }
+
+  void flushInPlace() {
+    if (fd_ < 0) {
+      openFile();
+      if (fd_ < 0) {
+        return; // Error already reported
+      }
+    }
+
+    struct iovec iov[2];
+    int count = windowIovec(buffer_.beginOffset(), iov);
+#if IOURING_AVAILABLE
+    if (submitWrite(iov, count, 0, /*truncate=*/true,
+                    static_cast<off_t>(buffer_.size()))) {
+      fileStart_ = buffer_.beginOffset();
+      fileEnd_ = buffer_.endOffset();
+      return;
+    }
+#endif
+    if (!writeFully(fd_, iov, count, 0)) {
+      reportError("Failed to write to log file");
+      closeFile();
+      return;
+    }
+
+    // Truncate file to exact size
+    if (::ftruncate(fd_, static_cast<off_t>(buffer_.size())) != 0) {
+      reportError("Failed to resize log file");
+    }
+    fileStart_ = buffer_.beginOffset();
+    fileEnd_ = buffer_.endOffset();
+  }
+
+  // Writes the window to an unnamed O_TMPFILE where available, so a
+  // half-written file is never visible under any name nor left behind by a
+  // crash. It only gets the .tmp name right before the rename: linkat()
+  // cannot replace the log file itself.
+  void flushAtomic(struct iovec *iov, int count) {
+    std::string tmpFile = config_.logFile + ".tmp";
+
+    int tmp = openUnnamedTemp();
+    bool unnamed = tmp >= 0;
+    if (!unnamed) {
+      tmp = ::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                   0644);
+    }
+    if (tmp < 0) {
+      reportError("Failed to open temp file for atomic write");
+      return;
+    }
+
+    bool written = writeFully(tmp, iov, count, 0);
+    if (written && sync_ && sync_->always()) {
+      // Durable before the rename makes it the log file
+      written = sync_->commit(this, tmp);
+    }
+    if (written && unnamed) {
+      char path[32];
+      std::snprintf(path, sizeof(path), "/proc/self/fd/%d", tmp);
+      ::unlink(tmpFile.c_str()); // Left over from a crash
+      written = ::linkat(AT_FDCWD, path, AT_FDCWD, tmpFile.c_str(),
+                         AT_SYMLINK_FOLLOW) == 0;
+    }
+    if (!written) {
+      reportError("Failed to write temp file for atomic write");
+      ::close(tmp);
+      if (!unnamed) {
+        std::remove(tmpFile.c_str());
+      }
+      return;
+    }
+
+    // Atomic rename
+    if (std::rename(tmpFile.c_str(), config_.logFile.c_str()) != 0) {
+      reportError("Failed to rename temp file: " + std::string(std::strerror(errno)));
+      std::remove(tmpFile.c_str()); // Clean up
+      ::close(tmp);
+      return;
+    }
+
+    if (!sync_) {
+      ::close(tmp);
+      return;
+    }
+    if (sync_->always()) {
+      ::close(tmp);
+    } else {
+      sync_->commit(this, tmp, /*owned=*/true); // Synced and closed later
+    }
+    // The rename itself is durable once the directory is synced
+    int dir = directoryFd();
+    if (dir >= 0) {
+      sync_->commit(&dirFd_, dir);
+    }
+  }
+
+  // An O_TMPFILE in the log file's directory, or -1 where the kernel or
+  // filesystem has none (then remembered, so it is tried only once)
+  int openUnnamedTemp() {
+#if defined(__linux__) && defined(O_TMPFILE)
+    if (unnamedTemp_) {
+      auto dir = std::filesystem::path(config_.logFile).parent_path();
+      int fd = ::open(dir.empty() ? "." : dir.c_str(),
+                      O_TMPFILE | O_WRONLY | O_CLOEXEC, 0644);
+      if (fd >= 0) {
+        return fd;
+      }
+      unnamedTemp_ = false;
+    }
+#endif
+    return -1;
+  }
+
+  // The log file's directory, opened once, for syncing renames
+  int directoryFd() {
+    if (dirFd_ < 0) {
+      auto dir = std::filesystem::path(config_.logFile).parent_path();
+      dirFd_ = ::open(dir.empty() ? "." : dir.c_str(),
+                      O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (dirFd_ < 0) {
+        reportError("Failed to open log directory for syncing");
+      }
+    }
+    return dirFd_;
+  }
+#else
+  void openFile() {
+    if (atomicWrites_) {
+      // Atomic writes don't keep file open
+      return;
+    }
 
+    createParentDirectory();
     fileStream_ = std::make_unique<std::fstream>(
         config_.logFile,
         std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
@@ -320,7 +4335,8 @@ private:
     }
   }
 
-  void flushLocked() {
+  void flush(bool /*compact*/ = false) {
+    auto start = std::chrono::steady_clock::now();
     std::string content;
     buffer_.assemble(content);
 
@@ -329,9 +4345,14 @@ private:
     } else {
       flushInPlace(content);
     }
+    if (index_.active()) {
+      writeIndex(buffer_.beginOffset());
+    }
 
     dirty_ = false;
-    lastFlushTime_ = std::chrono::steady_clock::now();
+    auto now = std::chrono::steady_clock::now();
+    stats_.recordFlush(now - start);
+    policy_.onFlush(now);
   }
 
   void flushInPlace(const std::string &content) {
@@ -362,69 +4383,850 @@ private:
   }
 
   void flushAtomic(const std::string &content) {
+    // Fall back to non-atomic on non-POSIX systems
+    std::ofstream out(config_.logFile, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      reportError("Failed to open log file (atomic writes not supported on this platform)");
+      return;
+    }
+    out.write(content.data(), static_cast<std::streamsize>(content.size()));
+  }
+
+  bool needsCompaction() const { return false; }
+
+  void completeIo() {}
+#endif
+
+  void writeIndex(uint64_t fileStart) {
+    if (!index_.write(buffer_, fileStart)) {
+      reportError("Failed to write line index");
+    }
+  }
+
+  void reportError(const std::string &msg) {
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastErrorTime_ >= std::chrono::seconds(2)) {
+      std::cerr << "Error: " << msg << " (" << std::strerror(errno) << ")\n";
+      lastErrorTime_ = now;
+    }
+  }
+
+  const Config config_; // Each stream's writer owns a copy
+  Waker &waker_;
+  FlushPolicy policy_;
+  StreamStats stats_;
+  LineFilter filter_;
+  bool atomicWrites_;
+  bool incremental_;
+  bool collapse_;
+
 #if POSIX_AVAILABLE
-    std::string tmpFile = config_.logFile + ".tmp";
+  MappedWindow mapped_; // Must precede buffer_, which may live inside it
+  ChangeNotifier notifier_;
+#endif
+  LineBuffer buffer_; // Writer thread only
+  LineQueue queue_;
+  ChunkStore chunks_;       // Sealed part of the window (--compress)
+  std::string sealScratch_; // Open chunk, made contiguous for compression
+  LineIndex index_;         // <logfile>.idx sidecar (--index)
+  HistoryLog history_;      // Evicted lines on disk (--history)
+  std::string evicted_;     // Evicted lines not yet in history_
+  std::chrono::steady_clock::time_point spillDue_; // Set while evicted_ waits
+  std::string carry_; // Line split across the queue's wrap point
+  size_t limit_;      // Window size: --max-size, or the budget share
+  MemoryBudget *budget_ = nullptr;         // --memory-budget
+  MemoryBudget::Share *share_ = nullptr;
+  SegmentSplitter splitSegment_; // drainQueue's loop for this configuration
+  // --collapse-repeats: start of the newest line and how often it occurred
+  uint64_t repeatStart_ = 0;
+  size_t repeatLen_ = 0;
+  uint64_t repeatCount_ = 0;
+  uint64_t rewrittenFrom_ = UINT64_MAX; // Lowest offset rewritten since flush
+  bool dirty_ = false;
+  bool resumed_ = false; // Window seeded by --resume, not yet on disk
 
-    std::ofstream tmp(tmpFile, std::ios::binary | std::ios::trunc);
-    if (!tmp) {
-      reportError("Failed to open temp file for atomic write");
+#if POSIX_AVAILABLE
+  WindowServer *server_ = nullptr; // --serve
+  SyncScheduler *sync_ = nullptr;  // --durability
+  int fd_ = -1;
+  int dirFd_ = -1;          // Log directory, for syncing atomic renames
+  bool unnamedTemp_ = true; // O_TMPFILE still worth trying
+  // Logical buffer offsets of the first and one-past-last byte in the file
+  uint64_t fileStart_ = 0;
+  uint64_t fileEnd_ = 0;
+  size_t blockSize_ = 4096; // Filesystem block size, for collapse alignment
+#if IOURING_AVAILABLE
+  static constexpr uint64_t kWriteOp = 1;
+  static constexpr uint64_t kTruncateOp = 2;
+  static constexpr uint64_t kSyncOp = 3;
+  IoUring uring_;
+  struct iovec uringIov_[2]; // Must outlive the in-flight write
+  size_t uringExpected_ = 0;
+  unsigned inflight_ = 0;
+  off_t truncateTo_ = -1; // Synchronous ftruncate still owed after the write
+  bool uringTruncate_ = true;
+  bool syncLinked_ = false; // In-flight chain ends in an fdatasync
+#endif
+#else
+  std::unique_ptr<std::fstream> fileStream_;
+#endif
+  std::chrono::steady_clock::time_point lastErrorTime_;
+};
+
+// ============================================================================
+// WriterPool: A few threads servicing the writers of every input stream
+// ============================================================================
+
+class WriterPool {
+public:
+  explicit WriterPool(size_t threads) {
+    for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i) {
+      workers_.push_back(std::make_unique<Worker>());
+    }
+  }
+
+  ~WriterPool() { shutdown(); }
+
+  // Creates the writer for one stream; writers are spread over the threads
+  // round-robin. Must be called before start().
+  Writer &add(const Config &config) {
+    Worker &worker = *workers_[writers_.size() % workers_.size()];
+    writers_.push_back(std::make_unique<Writer>(config, worker.waker));
+    worker.writers.push_back(writers_.back().get());
+    return *writers_.back();
+  }
+
+  void start() {
+    for (auto &worker : workers_) {
+      if (!worker->writers.empty()) {
+        Worker *w = worker.get();
+        w->thread = std::thread([this, w]() { run(*w); });
+      }
+    }
+  }
+
+  // Returns once every line queued so far has been flushed
+  void shutdown() {
+    shuttingDown_.store(true, std::memory_order_release);
+    for (auto &worker : workers_) {
+      worker->waker.wake();
+    }
+    for (auto &worker : workers_) {
+      if (worker->thread.joinable()) {
+        worker->thread.join();
+      }
+    }
+  }
+
+private:
+  struct Worker {
+    Waker waker;
+    std::vector<Writer *> writers;
+    std::thread thread;
+  };
+
+  // Services each writer, then sleeps until new input or the earliest flush
+  // deadline. A shutdown seen before the pass means that pass drained all
+  // queued input, as the reader stops producing before calling shutdown().
+  void run(Worker &worker) {
+    while (true) {
+      bool stopping = shuttingDown_.load(std::memory_order_acquire);
+      auto deadline = std::chrono::steady_clock::time_point::max();
+      for (Writer *writer : worker.writers) {
+        deadline = std::min(deadline, writer->service());
+      }
+      if (stopping) {
+        break;
+      }
+      worker.waker.sleepUntil(deadline, [&]() {
+        if (shuttingDown_.load(std::memory_order_acquire)) {
+          return true;
+        }
+        return std::any_of(worker.writers.begin(), worker.writers.end(),
+                           [](const Writer *w) { return w->needsService(); });
+      });
+    }
+
+    for (Writer *writer : worker.writers) {
+      writer->finish();
+    }
+  }
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::unique_ptr<Writer>> writers_;
+  std::atomic<bool> shuttingDown_{false};
+};
+
+// ============================================================================
+// StatsReporter: JSON snapshots of every stream's counters
+// ============================================================================
+
+class StatsReporter {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit StatsReporter(std::vector<Writer *> writers)
+      : writers_(std::move(writers)), previous_(writers_.size()),
+        start_(Clock::now()), last_(start_) {}
+
+  ~StatsReporter() { stop(); }
+
+  // One JSON object on a single line. Rates cover the time since this
+  // reporter's previous snapshot, so each consumer needs its own reporter.
+  std::string snapshot() {
+    auto now = Clock::now();
+    double seconds = std::chrono::duration<double>(now - last_).count();
+    auto perSecond = [&](uint64_t delta) {
+      return std::to_string(seconds > 0 ? static_cast<uint64_t>(
+                                              static_cast<double>(delta) /
+                                              seconds)
+                                        : 0);
+    };
+
+    std::string out = "{\"uptime_ms\":" +
+                      std::to_string(std::chrono::duration_cast<
+                                         std::chrono::milliseconds>(now - start_)
+                                         .count()) +
+                      ",\"streams\":[";
+    for (size_t i = 0; i < writers_.size(); ++i) {
+      const StreamStats &s = writers_[i]->stats();
+      uint64_t lines = s.reader.linesIn.get();
+      uint64_t bytes = s.reader.bytesIn.get();
+      out += i == 0 ? "{" : ",{";
+      out += "\"log\":\"" + jsonEscape(writers_[i]->logFile()) + "\"";
+      out += ",\"lines_in\":" + std::to_string(lines);
+      out += ",\"bytes_in\":" + std::to_string(bytes);
+      out += ",\"lines_per_sec\":" + perSecond(lines - previous_[i].lines);
+      out += ",\"bytes_per_sec\":" + perSecond(bytes - previous_[i].bytes);
+      out += ",\"lines_dropped\":" + std::to_string(s.reader.linesDropped.get());
+      out += ",\"lines_filtered\":" +
+             std::to_string(s.reader.linesFiltered.get());
+      out += ",\"lines_evicted\":" + std::to_string(s.writer.linesEvicted.get());
+      out += ",\"lines_collapsed\":" +
+             std::to_string(s.writer.linesCollapsed.get());
+      out += ",\"flushes\":" + std::to_string(s.writer.flushes.get());
+      out += ",\"flush_p50_us\":" + std::to_string(s.flushQuantileUs(0.50));
+      out += ",\"flush_p99_us\":" + std::to_string(s.flushQuantileUs(0.99));
+      out += ",\"queue_stalls\":" + std::to_string(s.reader.queueStalls.get());
+      out += ",\"queue_wait_us\":" + std::to_string(s.reader.queueWaitUs.get());
+      out += "}";
+      previous_[i] = {lines, bytes};
+    }
+    out += "]}";
+    last_ = now;
+    return out;
+  }
+
+  // Rewrites `path` every `interval`, and once more on stop(). Each update
+  // is renamed into place, so readers never see a partial file.
+  void start(const std::string &path, std::chrono::milliseconds interval) {
+    thread_ = std::thread([this, path, interval]() {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (true) {
+        cv_.wait_for(lock, interval, [this]() { return stopping_; });
+        bool last = stopping_;
+        lock.unlock();
+        writeFile(path);
+        lock.lock();
+        if (last) {
+          break;
+        }
+      }
+    });
+  }
+
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    cv_.notify_one();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+private:
+  struct Totals {
+    uint64_t lines = 0;
+    uint64_t bytes = 0;
+  };
+
+  static std::string jsonEscape(const std::string &in) {
+    std::string out;
+    for (char c : in) {
+      if (c == '"' || c == '\\') {
+        out += '\\';
+        out += c;
+      } else if (static_cast<unsigned char>(c) < 0x20) {
+        const char *hex = "0123456789abcdef";
+        out += "\\u00";
+        out += hex[(c >> 4) & 0xf];
+        out += hex[c & 0xf];
+      } else {
+        out += c;
+      }
+    }
+    return out;
+  }
+
+  void writeFile(const std::string &path) {
+    std::string tmpFile = path + ".tmp";
+    {
+      std::ofstream out(tmpFile, std::ios::binary | std::ios::trunc);
+      out << snapshot() << '\n';
+      if (!out) {
+        return;
+      }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmpFile, path, ec);
+  }
+
+  std::vector<Writer *> writers_;
+  std::vector<Totals> previous_;
+  Clock::time_point start_;
+  Clock::time_point last_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_ = false;
+  std::thread thread_;
+};
+
+// ============================================================================
+// ParallelParser: Staged read -> parse -> commit pipeline (--parse-threads)
+// ============================================================================
+//
+// For inputs faster than one thread can frame. The reader cuts every read
+// at its last newline, so each block holds whole lines and parses on its
+// own; the tail is carried into the next block. Workers split, strip CRs,
+// cap and filter blocks in parallel into runs of consecutive kept lines
+// (still pointing into the block, nothing is copied). A single commit
+// thread then hands each block's runs to the writer in block order. Line
+// order is preserved, the writer's queue keeps exactly one producer, and
+// --sample/--rate-limit decisions are still taken in line order.
+
+class ParallelParser {
+public:
+  ParallelParser(Writer &writer, size_t maxSize, size_t threads)
+      : writer_(writer), filter_(writer.filter()), maxSize_(maxSize),
+        filtering_(filter_.active()), stamping_(writer.timestamps()),
+        maxInFlight_(2 * threads + 2) {
+    for (size_t i = 0; i < threads; ++i) {
+      workers_.emplace_back([this]() { parseLoop(); });
+    }
+    committer_ = std::thread([this]() { commitLoop(); });
+  }
+
+  ~ParallelParser() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    workCv_.notify_all();
+    doneCv_.notify_all();
+    for (auto &worker : workers_) {
+      worker.join();
+    }
+    committer_.join();
+  }
+
+  ParallelParser(const ParallelParser &) = delete;
+  ParallelParser &operator=(const ParallelParser &) = delete;
+
+  void consume(const char *data, size_t len) {
+    bytesIn_ += len;
+    const char *end = data + len;
+    if (dropping_) {
+      const char *nl = static_cast<const char *>(
+          std::memchr(data, '\n', static_cast<size_t>(end - data)));
+      if (!nl) {
+        return;
+      }
+      dropping_ = false; // Finished dropping overlong line
+      data = nl + 1;
+    }
+
+#if defined(__GLIBC__) && defined(_GNU_SOURCE)
+    const char *nl = static_cast<const char *>(
+        ::memrchr(data, '\n', static_cast<size_t>(end - data)));
+    const char *last = nl ? nl + 1 : data;
+#else
+    const char *last = end;
+    while (last > data && last[-1] != '\n') {
+      --last;
+    }
+#endif
+    if (last == data) {
+      carry(data, end);
       return;
     }
+    Block *block = acquire();
+    block->bytes.assign(carry_);
+    block->bytes.append(data, static_cast<size_t>(last - data));
+    carry_.clear();
+    carry(last, end);
+    submit(block);
+  }
 
-    tmp.write(content.data(), static_cast<std::streamsize>(content.size()));
-    tmp.close();
+  // Commits the unterminated last line, if any, and waits until every line
+  // consumed so far has been handed to the writer
+  void finish() {
+    Block *block = acquire();
+    block->bytes.swap(carry_);
+    carry_.clear();
+    dropping_ = false;
+    submit(block);
 
-    if (!tmp) {
-      reportError("Failed to write temp file for atomic write");
+    std::unique_lock<std::mutex> lock(mutex_);
+    spaceCv_.wait(lock, [this]() { return inOrder_.empty(); });
+  }
+
+private:
+  struct Run {
+    std::string_view text; // Kept lines joined by '\n', without the last
+    size_t lines;
+    int throttle; // Rule still to be applied at commit time, or -1
+  };
+
+  struct Block {
+    std::string bytes;
+    std::vector<Run> runs;
+    size_t bytesIn = 0;  // Input bytes accounted to this block
+    size_t dropped = 0;  // Overlong lines
+    size_t filtered = 0; // Lines rejected by the stateless filter
+    std::string stamp; // --timestamps prefix of its lines
+    bool parsed = false;
+  };
+
+  // Buffers the tail of a read that has no newline yet, dropping the line
+  // once it can no longer fit
+  void carry(const char *data, const char *end) {
+    size_t len = static_cast<size_t>(end - data);
+    if (carry_.size() + len > maxSize_ - 1) {
+      carry_.clear();
+      dropping_ = true;
+      ++dropped_;
       return;
     }
+    carry_.append(data, len);
+  }
 
-    // Atomic rename
-    if (std::rename(tmpFile.c_str(), config_.logFile.c_str()) != 0) {
-      reportError("Failed to rename temp file: " + std::string(std::strerror(errno)));
-      std::remove(tmpFile.c_str()); // Clean up
+  Block *acquire() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // Backpressure: never more than a few blocks ahead of the commit stage
+    spaceCv_.wait(lock, [this]() { return inOrder_.size() < maxInFlight_; });
+    if (free_.empty()) {
+      blocks_.push_back(std::make_unique<Block>());
+      return blocks_.back().get();
     }
-#else
-    // Fall back to non-atomic on non-POSIX systems
-    std::ofstream out(config_.logFile, std::ios::binary | std::ios::trunc);
-    if (!out) {
-      reportError("Failed to open log file (atomic writes not supported on this platform)");
+    Block *block = free_.back();
+    free_.pop_back();
+    return block;
+  }
+
+  void submit(Block *block) {
+    if (stamping_) {
+      block->stamp.assign(timestamper_.stamp()); // On arrival, not on parse
+    }
+    block->bytesIn = bytesIn_;
+    block->dropped = dropped_;
+    bytesIn_ = 0;
+    dropped_ = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      block->parsed = false;
+      inOrder_.push_back(block);
+      todo_.push_back(block);
+    }
+    workCv_.notify_one();
+  }
+
+  void parseLoop() {
+    while (true) {
+      Block *block;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        workCv_.wait(lock, [this]() { return stopping_ || !todo_.empty(); });
+        if (todo_.empty()) {
+          return;
+        }
+        block = todo_.front();
+        todo_.pop_front();
+      }
+      parse(*block);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        block->parsed = true;
+      }
+      doneCv_.notify_one();
+    }
+  }
+
+  // Same rules as LineSplitter::emitLine, applied to a whole block. Kept
+  // lines that follow each other with a plain '\n' between them become one
+  // run, so a clean block is handed over as a single span.
+  void parse(Block &block) {
+    block.runs.clear();
+    block.filtered = 0;
+    const char *data = block.bytes.data();
+    const char *end = data + block.bytes.size();
+    const char *runStart = nullptr;
+    const char *runEnd = nullptr;
+    size_t runLines = 0;
+    auto closeRun = [&]() {
+      if (runStart) {
+        block.runs.push_back(
+            {{runStart, static_cast<size_t>(runEnd - runStart)}, runLines, -1});
+        runStart = nullptr;
+      }
+    };
+
+    while (data < end) {
+      const char *nl = static_cast<const char *>(
+          std::memchr(data, '\n', static_cast<size_t>(end - data)));
+      const char *lineEnd = nl ? nl : end;
+      std::string_view line(data, static_cast<size_t>(lineEnd - data));
+      bool cr = !line.empty() && line.back() == '\r';
+      if (cr) {
+        line.remove_suffix(1);
+      }
+      data = nl ? nl + 1 : end;
+
+      if (line.size() + 1 > maxSize_) {
+        ++block.dropped;
+        closeRun();
+        continue;
+      }
+      if (filtering_ && !filter_.matches(line)) {
+        ++block.filtered;
+        closeRun();
+        continue;
+      }
+      int throttle = filtering_ ? filter_.throttleFor(line) : -1;
+      if (throttle >= 0) {
+        closeRun();
+        block.runs.push_back({line, 1, throttle});
+        continue;
+      }
+      if (runStart && runEnd + 1 == line.data()) {
+        runEnd = line.data() + line.size();
+        ++runLines;
+      } else {
+        closeRun();
+        runStart = line.data();
+        runEnd = runStart + line.size();
+        runLines = 1;
+      }
+      if (cr || stamping_) {
+        // The '\r' sits between this line and the next, or each line
+        // needs its own prefix
+        closeRun();
+      }
+    }
+    closeRun();
+  }
+
+  void commitLoop() {
+    std::vector<std::string_view> views;
+    while (true) {
+      Block *block;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        doneCv_.wait(lock, [this]() {
+          return stopping_ || (!inOrder_.empty() && inOrder_.front()->parsed);
+        });
+        if (inOrder_.empty() || !inOrder_.front()->parsed) {
+          return;
+        }
+        block = inOrder_.front();
+      }
+
+      views.clear();
+      size_t lines = 0;
+      size_t filtered = block->filtered;
+      auto now = std::chrono::steady_clock::now();
+      for (const Run &run : block->runs) {
+        if (run.throttle >= 0 && !filter_.admit(run.throttle, now)) {
+          ++filtered;
+          continue;
+        }
+        views.push_back(run.text);
+        lines += run.lines;
+      }
+      // This thread is the only producer of the writer's queue and of the
+      // reader-side counters
+      StreamStats::ReaderSide &stats = writer_.stats().reader;
+      stats.bytesIn.add(block->bytesIn);
+      stats.linesDropped.add(block->dropped);
+      stats.linesFiltered.add(filtered);
+      stats.linesIn.add(lines);
+      writer_.appendLines(views, block->stamp);
+
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        inOrder_.pop_front();
+        free_.push_back(block);
+      }
+      spaceCv_.notify_all();
+    }
+  }
+
+  Writer &writer_;
+  LineFilter &filter_;
+  size_t maxSize_;
+  bool filtering_;
+  bool stamping_;
+  size_t maxInFlight_;
+
+  // Reader thread only
+  std::string carry_; // Unterminated tail of the previous read
+  Timestamper timestamper_;
+  bool dropping_ = false;
+  size_t bytesIn_ = 0;
+  size_t dropped_ = 0;
+
+  std::mutex mutex_;
+  std::condition_variable workCv_;  // todo_ gained a block, or stopping
+  std::condition_variable doneCv_;  // A block was parsed, or stopping
+  std::condition_variable spaceCv_; // A block was committed
+  std::deque<Block *> todo_;        // Submitted, not yet picked by a worker
+  std::deque<Block *> inOrder_;     // Submitted, not yet committed
+  std::vector<Block *> free_;
+  std::vector<std::unique_ptr<Block>> blocks_;
+  bool stopping_ = false;
+  std::vector<std::thread> workers_;
+  std::thread committer_;
+};
+
+// ============================================================================
+// LineSplitter: Per-source line framing with CRLF normalization and capping
+// ============================================================================
+
+class LineSplitter {
+public:
+  // `parseThreads` > 1 hands framing to a ParallelParser. With
+  // --timestamps the prefix counts toward the line size limit.
+  LineSplitter(Writer &writer, size_t maxSize, size_t parseThreads = 1)
+      : writer_(writer), filter_(writer.filter()),
+        stamping_(writer.timestamps()),
+        maxSize_(stamping_ ? maxSize - Timestamper::kWidth : maxSize),
+        filtering_(filter_.active()),
+        processChunk_(selectProcessor(filtering_, filter_.needsClock())) {
+    if (parseThreads > 1) {
+      parallel_ =
+          std::make_unique<ParallelParser>(writer, maxSize_, parseThreads);
+    }
+  }
+
+  // Splits one chunk of input and hands its complete lines to the writer
+  void consume(const char *data, size_t len) {
+    if (parallel_) {
+      parallel_->consume(data, len);
+      return;
+    }
+    writer_.stats().reader.bytesIn.add(len);
+    if (stamping_) {
+      stamp_ = timestamper_.stamp(); // Shared by every line of this read
+    }
+    (this->*processChunk_)(data, len);
+    flushPending();
+  }
+
+  // Emits the unterminated last line, if any (end of input or rotation)
+  void finish() {
+    if (parallel_) {
+      parallel_->finish();
+      return;
+    }
+    if (!currentLine_.empty()) {
+      if (filtering_) {
+        emitLine<true>(currentLine_);
+      } else {
+        emitLine<false>(currentLine_);
+      }
+      flushPending();
+      currentLine_.clear();
+    }
+    droppingLine_ = false;
+  }
+
+private:
+  using ChunkProcessor = void (LineSplitter::*)(const char *, size_t);
+
+  // Picks the processChunk specialization for this source's features, so
+  // the per-line loop carries no checks for features that are off
+  static ChunkProcessor selectProcessor(bool filter, bool clock) {
+    static constexpr ChunkProcessor kProcessors[] = {
+        &LineSplitter::processChunk<false, false>,
+        &LineSplitter::processChunk<false, true>,
+        &LineSplitter::processChunk<true, false>,
+        &LineSplitter::processChunk<true, true>,
+    };
+    return kProcessors[(filter ? 2 : 0) + (clock ? 1 : 0)];
+  }
+
+  // Splits a chunk on '\n' with memchr (vectorized by libc, with runtime CPU
+  // dispatch) and queues each complete line as a span into the chunk. Only a
+  // line that straddles chunks is copied (into currentLine_, then joined_).
+  // Only the first line of a chunk can continue a partial or dropped line,
+  // so that state is checked once per chunk rather than once per line.
+  template <bool Filter, bool Clock>
+  void processChunk(const char *data, size_t len) {
+    if constexpr (Clock) {
+      chunkTime_ = std::chrono::steady_clock::now();
+    }
+    const char *end = data + len;
+    if (droppingLine_ || !currentLine_.empty()) {
+      const char *nl = static_cast<const char *>(std::memchr(data, '\n', len));
+      if (!nl) {
+        appendPartial(data, len);
+        return;
+      }
+      finishLine<Filter>(data, static_cast<size_t>(nl - data));
+      data = nl + 1;
+    }
+    while (data < end) {
+      const char *nl = static_cast<const char *>(
+          std::memchr(data, '\n', static_cast<size_t>(end - data)));
+      if (!nl) {
+        appendPartial(data, static_cast<size_t>(end - data));
+        return;
+      }
+      emitLine<Filter>(std::string_view(data, static_cast<size_t>(nl - data)));
+      data = nl + 1;
+    }
+  }
+
+  // Buffers the unterminated tail of a chunk, switching to dropping mode once
+  // the line can no longer fit (cap line length to prevent memory overflow)
+  void appendPartial(const char *data, size_t len) {
+    if (droppingLine_) {
+      return;
+    }
+    if (currentLine_.size() + len > maxSize_ - 1) {
+      droppingLine_ = true;
+      currentLine_.clear();
+      writer_.stats().reader.linesDropped.add(1);
       return;
     }
-    out.write(content.data(), static_cast<std::streamsize>(content.size()));
-#endif
+    currentLine_.append(data, len);
+  }
+
+  // Completes the current line with `len` bytes that precede a newline
+  template <bool Filter> void finishLine(const char *data, size_t len) {
+    if (droppingLine_) {
+      // Finished dropping overlong line
+      droppingLine_ = false;
+      return;
+    }
+    if (currentLine_.size() + len > maxSize_ - 1) {
+      currentLine_.clear();
+      writer_.stats().reader.linesDropped.add(1);
+      return;
+    }
+    // At most one line per chunk straddles a read; park it in joined_ so
+    // currentLine_ is free for this chunk's own unterminated tail.
+    currentLine_.append(data, len);
+    joined_.swap(currentLine_);
+    currentLine_.clear();
+    emitLine<Filter>(joined_);
+  }
+
+  template <bool Filter> void emitLine(std::string_view line) {
+    // CRLF normalization
+    if (!line.empty() && line.back() == '\r') {
+      line.remove_suffix(1);
+    }
+
+    // Check size limit (after CRLF normalization)
+    if (line.size() + 1 > maxSize_) {
+      // Drop overlong line
+      writer_.stats().reader.linesDropped.add(1);
+      return;
+    }
+
+    if constexpr (Filter) {
+      if (!filter_.keep(line, chunkTime_)) {
+        ++filtered_;
+        return;
+      }
+    }
+    pending_.push_back(line);
   }
 
-  void reportError(const std::string &msg) {
-    auto now = std::chrono::steady_clock::now();
-    if (now - lastErrorTime_ >= std::chrono::seconds(2)) {
-      std::cerr << "Error: " << msg << " (" << std::strerror(errno) << ")\n";
-      lastErrorTime_ = now;
+  // Hands every line queued from the last chunk to the writer in one call
+  void flushPending() {
+    if (filtered_ > 0) {
+      writer_.stats().reader.linesFiltered.add(filtered_);
+      filtered_ = 0;
     }
+    writer_.stats().reader.linesIn.add(pending_.size());
+    writer_.appendLines(pending_, stamp_);
+    pending_.clear();
   }
 
-  const Config &config_;
-  std::chrono::milliseconds interval_;
-  bool immediate_;
-  bool atomicWrites_;
-
-  std::mutex mutex_;
-  std::condition_variable cv_;
-  LineBuffer buffer_;
-  bool dirty_ = false;
-  bool shuttingDown_ = false;
-
-  std::unique_ptr<std::fstream> fileStream_;
-  std::chrono::steady_clock::time_point lastFlushTime_;
-  std::chrono::steady_clock::time_point lastErrorTime_;
+  Writer &writer_;
+  LineFilter &filter_;
+  bool stamping_;
+  size_t maxSize_; // Room for the line itself, after any prefix
+  bool filtering_;
+  ChunkProcessor processChunk_;
+  Timestamper timestamper_;
+  std::string_view stamp_; // Prefix for the current chunk's lines
+  std::chrono::steady_clock::time_point chunkTime_{};
+  size_t filtered_ = 0; // Filtered lines in the current chunk
+  std::vector<std::string_view> pending_; // Lines of the current chunk
+  std::string joined_; // Backing store for a line that straddled reads
+  std::string currentLine_;
+  bool droppingLine_ = false;
+  std::unique_ptr<ParallelParser> parallel_;
 };
 
 // ============================================================================
-// POSIX Signal Handling with Self-Pipe
+// POSIX Signal Handling (signalfd on Linux, self-pipe elsewhere)
 // ============================================================================
 
 #if POSIX_AVAILABLE
 
+// Becomes readable when SIGINT, SIGTERM or SIGUSR1 arrives
+static int g_signalFd = -1;
+
+#if EPOLL_AVAILABLE
+
+// Must run before any thread is started: the blocked mask is inherited, so
+// no writer thread can be picked to run a signal's default action.
+bool setupSignalHandling() {
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  sigaddset(&mask, SIGUSR1);
+  if (pthread_sigmask(SIG_BLOCK, &mask, nullptr) != 0) {
+    std::cerr << "Failed to block signals\n";
+    return false;
+  }
+
+  g_signalFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (g_signalFd < 0) {
+    std::cerr << "Failed to create signalfd: " << std::strerror(errno)
+              << '\n';
+    pthread_sigmask(SIG_UNBLOCK, &mask, nullptr);
+    return false;
+  }
+
+  return true;
+}
+
+void cleanupSignalHandling() {
+  if (g_signalFd >= 0) {
+    close(g_signalFd);
+    g_signalFd = -1;
+  }
+}
+
+#else
+
 static int g_signalPipe[2] = {-1, -1};
 
 void signalHandler(int sig) {
@@ -444,6 +5246,7 @@ bool setupSignalHandling() {
   // Set non-blocking on read end
   int flags = fcntl(g_signalPipe[0], F_GETFL, 0);
   fcntl(g_signalPipe[0], F_SETFL, flags | O_NONBLOCK);
+  g_signalFd = g_signalPipe[0];
 
   // Install signal handlers
   struct sigaction sa;
@@ -452,7 +5255,8 @@ bool setupSignalHandling() {
   sa.sa_flags = SA_RESTART; // Restart interrupted syscalls
 
   if (sigaction(SIGINT, &sa, nullptr) != 0 ||
-      sigaction(SIGTERM, &sa, nullptr) != 0) {
+      sigaction(SIGTERM, &sa, nullptr) != 0 ||
+      sigaction(SIGUSR1, &sa, nullptr) != 0) {
     std::cerr << "Failed to install signal handlers\n";
     return false;
   }
@@ -467,132 +5271,531 @@ void cleanupSignalHandling() {
   if (g_signalPipe[1] >= 0) {
     close(g_signalPipe[1]);
   }
+  g_signalFd = -1;
 }
 
+#endif // EPOLL_AVAILABLE
+
 // ============================================================================
 // POSIX Input Reader with Poll and Line Capping
 // ============================================================================
 
 class PosixInputReader {
 public:
-  PosixInputReader(Writer &writer, size_t maxSize)
-      : writer_(writer), maxSize_(maxSize) {}
+  explicit PosixInputReader(size_t maxSize) : maxSize_(maxSize) {
+#if EPOLL_AVAILABLE
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd_ < 0) {
+      std::cerr << "epoll_create1() error: " << std::strerror(errno) << '\n';
+      return;
+    }
+    struct epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr; // The signalfd
+    epoll_ctl(epollFd_, EPOLL_CTL_ADD, g_signalFd, &ev);
+#endif
+  }
+
+  ~PosixInputReader() {
+    for (auto &source : sources_) {
+      closeSource(*source);
+    }
+#if EPOLL_AVAILABLE
+    if (stdinFlags_ >= 0) {
+      fcntl(STDIN_FILENO, F_SETFL, stdinFlags_);
+    }
+    if (epollFd_ >= 0) {
+      ::close(epollFd_);
+    }
+#endif
+  }
+
+  PosixInputReader(const PosixInputReader &) = delete;
+  PosixInputReader &operator=(const PosixInputReader &) = delete;
+
+  // Target of the SIGUSR1 statistics dump
+  void setStatsReporter(StatsReporter *stats) { stats_ = stats; }
+
+  // Reads standard input until EOF
+  // `parseThreads` > 1 frames stdin on a ParallelParser pipeline
+  void addStdin(Writer &writer, size_t parseThreads = 1) {
+    growPipe(STDIN_FILENO);
+#if EPOLL_AVAILABLE
+    // Edge-triggered reads must run until EAGAIN; restored on exit
+    stdinFlags_ = fcntl(STDIN_FILENO, F_GETFL, 0);
+    if (stdinFlags_ >= 0) {
+      fcntl(STDIN_FILENO, F_SETFL, stdinFlags_ | O_NONBLOCK);
+    }
+#endif
+    addSource(SourceKind::Stream, STDIN_FILENO, writer, "stdin",
+              parseThreads);
+  }
+
+  // Opens `spec` as an input for `writer`: "unix:<path>" listens on a unix
+  // socket, an existing regular file is tailed from its current end, and
+  // anything else is read as a FIFO, created if it does not exist yet.
+  bool addInput(const std::string &spec, Writer &writer) {
+    if (spec.rfind("unix:", 0) == 0) {
+      return listenUnix(spec.substr(5), writer);
+    }
+
+    struct stat st;
+    if (stat(spec.c_str(), &st) != 0) {
+      if (errno != ENOENT || mkfifo(spec.c_str(), 0600) != 0) {
+        std::cerr << "Error: Failed to create FIFO " << spec << ": "
+                  << std::strerror(errno) << '\n';
+        return false;
+      }
+    } else if (S_ISREG(st.st_mode)) {
+      return tailFile(spec, writer);
+    } else if (!S_ISFIFO(st.st_mode)) {
+      std::cerr << "Error: " << spec
+                << " is not a FIFO, regular file or unix:<socket>\n";
+      return false;
+    }
+
+    // O_RDWR keeps a writer attached, so the FIFO never reports EOF while
+    // producers come and go
+    int fd = ::open(spec.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+      std::cerr << "Error: Failed to open " << spec << ": "
+                << std::strerror(errno) << '\n';
+      return false;
+    }
+    growPipe(fd);
+    addSource(SourceKind::Stream, fd, writer, spec);
+    return true;
+  }
 
+  // Multiplexes every source in one event loop. Returns when a signal
+  // arrives or every source has reached EOF.
   bool readLoop() {
-    struct pollfd fds[2];
-    fds[0].fd = STDIN_FILENO;
-    fds[0].events = POLLIN;
-    fds[1].fd = g_signalPipe[0];
-    fds[1].events = POLLIN;
+#if EPOLL_AVAILABLE
+    bool ok = epollLoop();
+#else
+    bool ok = pollLoop();
+#endif
+
+    // Process any remaining partial lines
+    for (auto &source : sources_) {
+      source->splitter.finish();
+    }
 
-    char buffer[8192];
+    return ok;
+  }
 
-    while (!shuttingDown_) {
-      int ret = poll(fds, 2, -1);
+private:
+  static constexpr size_t kMinReadSize = 64 * 1024;
+  static constexpr size_t kMaxReadSize = 1024 * 1024;
+  static constexpr int kTailPollMs = 250;
+  static constexpr int kMaxEvents = 64;
 
-      if (ret < 0) {
+  enum class SourceKind {
+    Stream,   // stdin, a FIFO or an accepted connection: read until EOF
+    Tail,     // Regular file: polled for growth, truncation and rotation
+    Listener, // Listening unix socket: each connection becomes a Stream
+  };
+
+  struct Source {
+    Source(SourceKind k, int f, Writer &w, size_t maxSize, std::string p,
+           size_t parseThreads)
+        : kind(k), fd(f), writer(w), splitter(w, maxSize, parseThreads),
+          path(std::move(p)) {}
+
+    SourceKind kind;
+    int fd;
+    Writer &writer;
+    LineSplitter splitter; // Each source frames its own lines
+    std::string path;
+    dev_t device = 0; // Tail: identity of the open file, to detect rotation
+    ino_t inode = 0;
+    bool ready = false; // Queued in ready_ (epoll)
+    bool closed = false;
+  };
+
+  Source &addSource(SourceKind kind, int fd, Writer &writer,
+                    std::string path, size_t parseThreads = 1) {
+    sources_.push_back(std::make_unique<Source>(
+        kind, fd, writer, maxSize_, std::move(path), parseThreads));
+    Source &source = *sources_.back();
+    if (kind == SourceKind::Tail) {
+      ++tailCount_;
+    }
+#if EPOLL_AVAILABLE
+    if (kind != SourceKind::Tail) {
+      watch(source);
+    }
+#endif
+    return source;
+  }
+
+#if EPOLL_AVAILABLE
+  void watch(Source &source) {
+    struct epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = &source;
+    // Registration reports data that is already pending as the first edge.
+    // Regular files and /dev/null can't be watched but never block: keep
+    // such a source ready until it reaches EOF.
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, source.fd, &ev) != 0) {
+      markReady(source);
+    }
+  }
+
+  void markReady(Source &source) {
+    if (!source.ready) {
+      source.ready = true;
+      ready_.push_back(&source);
+    }
+  }
+
+  // Edge-triggered: an event only marks its source ready, and each ready
+  // source then gets one read() per turn until it reports EAGAIN. The cost
+  // of a wake-up scales with the active sources, not with all of them, and
+  // a busy source cannot starve the others.
+  bool epollLoop() {
+    if (epollFd_ < 0) {
+      return false;
+    }
+    struct epoll_event events[kMaxEvents];
+
+    while (!shuttingDown_ && !sources_.empty()) {
+      int timeout = !ready_.empty() ? 0 : tailCount_ > 0 ? kTailPollMs : -1;
+      int n = epoll_wait(epollFd_, events, kMaxEvents, timeout);
+
+      if (n < 0) {
         if (errno == EINTR) {
           continue;
         }
-        std::cerr << "poll() error: " << std::strerror(errno) << '\n';
+        std::cerr << "epoll_wait() error: " << std::strerror(errno) << '\n';
         return false;
       }
 
-      // Check signal pipe
-      if (fds[1].revents & POLLIN) {
-        char dummy;
-        while (read(g_signalPipe[0], &dummy, 1) > 0) {
-          // Drain pipe
+      for (int i = 0; i < n; ++i) {
+        if (events[i].data.ptr == nullptr) {
+          if (handleSignals()) {
+            shuttingDown_ = true;
+            return true;
+          }
+          continue;
         }
-        shuttingDown_ = true;
-        break;
+        markReady(*static_cast<Source *>(events[i].data.ptr));
       }
 
-      // Check stdin
-      if (fds[0].revents & POLLIN) {
-        ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
-
-        if (n < 0) {
-          if (errno == EINTR || errno == EAGAIN) {
-            continue;
-          }
-          std::cerr << "read() error: " << std::strerror(errno) << '\n';
-          return false;
+      // Sources accepted during this pass are appended; serve them next turn
+      size_t count = ready_.size();
+      size_t kept = 0;
+      for (size_t i = 0; i < count; ++i) {
+        Source &source = *ready_[i];
+        bool more = false;
+        if (source.kind == SourceKind::Listener) {
+          acceptConnections(source);
+        } else {
+          more = readStream(source);
+        }
+        if (more) {
+          ready_[kept++] = &source;
+        } else {
+          source.ready = false;
         }
+      }
+      ready_.erase(ready_.begin() + static_cast<std::ptrdiff_t>(kept),
+                   ready_.begin() + static_cast<std::ptrdiff_t>(count));
 
-        if (n == 0) {
-          // EOF
-          shuttingDown_ = true;
-          break;
+      scanTails();
+      removeClosedSources();
+    }
+
+    return true;
+  }
+
+#else
+
+  bool pollLoop() {
+    std::vector<struct pollfd> fds;
+    std::vector<Source *> polled;
+
+    while (!shuttingDown_ && !sources_.empty()) {
+      fds.assign(1, {g_signalFd, POLLIN, 0});
+      polled.clear();
+      for (auto &source : sources_) {
+        if (source->kind != SourceKind::Tail) {
+          fds.push_back({source->fd, POLLIN, 0});
+          polled.push_back(source.get());
         }
+      }
+
+      int ret = poll(fds.data(), fds.size(), tailCount_ > 0 ? kTailPollMs : -1);
 
-        processChunk(buffer, static_cast<size_t>(n));
+      if (ret < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        std::cerr << "poll() error: " << std::strerror(errno) << '\n';
+        return false;
       }
 
-      if (fds[0].revents & (POLLHUP | POLLERR)) {
-        // stdin closed or error
+      // Check signal pipe
+      if ((fds[0].revents & POLLIN) && handleSignals()) {
         shuttingDown_ = true;
-        break;
+        return true;
       }
+
+      for (size_t i = 0; i < polled.size(); ++i) {
+        Source &source = *polled[i];
+        short revents = fds[i + 1].revents;
+        if (revents == 0) {
+          continue;
+        }
+        if (source.kind == SourceKind::Listener) {
+          acceptConnections(source);
+        } else if (revents & POLLIN) {
+          // POLLHUP may accompany data; read on until EOF
+          readStream(source);
+        } else {
+          // Closed or error
+          source.closed = true;
+        }
+      }
+
+      scanTails();
+      removeClosedSources();
     }
 
-    // Process any remaining partial line
-    if (!currentLine_.empty()) {
-      emitLine();
+    return true;
+  }
+
+#endif // EPOLL_AVAILABLE
+
+  // Drains pending signals. Returns true if one of them asks us to exit;
+  // SIGUSR1 just prints a statistics snapshot to stderr.
+  bool handleSignals() {
+    bool terminate = false;
+#if EPOLL_AVAILABLE
+    struct signalfd_siginfo info;
+    while (read(g_signalFd, &info, sizeof(info)) == sizeof(info)) {
+      int sig = static_cast<int>(info.ssi_signo);
+#else
+    char byte;
+    while (read(g_signalFd, &byte, 1) > 0) {
+      int sig = byte;
+#endif
+      if (sig != SIGUSR1) {
+        terminate = true;
+      } else if (stats_) {
+        std::cerr << stats_->snapshot() << '\n';
+      }
+    }
+    return terminate;
+  }
+
+  // Regular files are always "readable", so they are scanned on a timer
+  void scanTails() {
+    if (tailCount_ == 0) {
+      return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (now < nextTailScan_) {
+      return;
+    }
+    for (auto &source : sources_) {
+      if (source->kind == SourceKind::Tail) {
+        readTail(*source);
+      }
     }
+    nextTailScan_ = now + std::chrono::milliseconds(kTailPollMs);
+  }
 
+  bool listenUnix(const std::string &path, Writer &writer) {
+    int fd = listenUnixSocket(path);
+    if (fd < 0) {
+      std::cerr << "Error: Failed to listen on " << path << ": "
+                << std::strerror(errno) << '\n';
+      return false;
+    }
+    addSource(SourceKind::Listener, fd, writer, path);
     return true;
   }
 
-private:
-  void processChunk(const char *data, size_t len) {
-    for (size_t i = 0; i < len; ++i) {
-      char c = data[i];
+  bool tailFile(const std::string &path, Writer &writer) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || lseek(fd, 0, SEEK_END) < 0) {
+      int err = errno;
+      std::cerr << "Error: Failed to open " << path << ": "
+                << std::strerror(err) << '\n';
+      if (fd >= 0) {
+        ::close(fd);
+      }
+      return false;
+    }
+    Source &source = addSource(SourceKind::Tail, fd, writer, path);
+    source.device = st.st_dev;
+    source.inode = st.st_ino;
+    return true;
+  }
 
-      if (c == '\n') {
-        if (droppingLine_) {
-          // Finished dropping overlong line
-          droppingLine_ = false;
-        } else {
-          emitLine();
-        }
-        currentLine_.clear();
-      } else if (droppingLine_) {
-        // Continue dropping
-        continue;
-      } else {
-        // Cap line length to prevent memory overflow
-        if (currentLine_.size() >= maxSize_ - 1) {
-          // Line too long, start dropping
-          droppingLine_ = true;
-          currentLine_.clear();
+  void acceptConnections(Source &listener) {
+    while (true) {
+      int fd = ::accept(listener.fd, nullptr, nullptr);
+      if (fd < 0) {
+        if (errno == EINTR || errno == ECONNABORTED) {
           continue;
         }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+          std::cerr << "accept() error on " << listener.path << ": "
+                    << std::strerror(errno) << '\n';
+        }
+        return;
+      }
+      (void)fcntl(fd, F_SETFD, FD_CLOEXEC);
+#if EPOLL_AVAILABLE
+      (void)fcntl(fd, F_SETFL, O_NONBLOCK);
+#endif
+      addSource(SourceKind::Stream, fd, listener.writer, listener.path);
+    }
+  }
 
-        currentLine_ += c;
+  // One read per turn, so a busy source cannot starve the others. Returns
+  // false once the source is drained (EAGAIN) or closed.
+  bool readStream(Source &source) {
+    ssize_t n = read(source.fd, buffer_.data(), nextReadSize(source.fd));
+    if (n > 0) {
+      source.splitter.consume(buffer_.data(), static_cast<size_t>(n));
+      return true;
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        return true;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return false;
       }
+      std::cerr << "read() error on " << source.path << ": "
+                << std::strerror(errno) << '\n';
     }
+    source.closed = true; // EOF
+    return false;
   }
 
-  void emitLine() {
-    // CRLF normalization
-    if (!currentLine_.empty() && currentLine_.back() == '\r') {
-      currentLine_.pop_back();
+  // Reads whatever the file gained since the last scan, then follows the
+  // path: a new inode means the file was rotated (reopen it from the top),
+  // a size below our offset means it was truncated in place (rewind).
+  void readTail(Source &source) {
+    drainFile(source);
+
+    struct stat st;
+    if (stat(source.path.c_str(), &st) != 0) {
+      return; // Rotated away and not recreated yet
+    }
+    if (st.st_dev != source.device || st.st_ino != source.inode) {
+      int fd = ::open(source.path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0) {
+        return;
+      }
+      source.splitter.finish();
+      ::close(source.fd);
+      source.fd = fd;
+      source.device = st.st_dev;
+      source.inode = st.st_ino;
+    } else if (st.st_size < lseek(source.fd, 0, SEEK_CUR)) {
+      source.splitter.finish();
+      lseek(source.fd, 0, SEEK_SET);
+    } else {
+      return;
     }
+    drainFile(source);
+  }
 
-    // Check size limit (after CRLF normalization)
-    if (currentLine_.size() + 1 > maxSize_) {
-      // Drop overlong line
+  void drainFile(Source &source) {
+    while (true) {
+      ssize_t n = read(source.fd, buffer_.data(), nextReadSize(source.fd));
+      if (n <= 0) {
+        if (n < 0 && errno == EINTR) {
+          continue;
+        }
+        return;
+      }
+      source.splitter.consume(buffer_.data(), static_cast<size_t>(n));
+    }
+  }
+
+  void removeClosedSources() {
+    if (std::none_of(sources_.begin(), sources_.end(),
+                     [](const auto &s) { return s->closed; })) {
       return;
     }
+    auto isClosed = [](const std::unique_ptr<Source> &s) { return s->closed; };
+    for (auto &source : sources_) {
+      if (source->closed) {
+        source->splitter.finish();
+        closeSource(*source);
+      }
+    }
+    sources_.erase(std::remove_if(sources_.begin(), sources_.end(), isClosed),
+                   sources_.end());
+  }
+
+  void closeSource(Source &source) {
+#if EPOLL_AVAILABLE
+    if (source.kind != SourceKind::Tail && source.fd >= 0) {
+      epoll_ctl(epollFd_, EPOLL_CTL_DEL, source.fd, nullptr);
+    }
+#endif
+    if (source.kind == SourceKind::Tail && source.fd >= 0) {
+      --tailCount_;
+    }
+    if (source.fd != STDIN_FILENO && source.fd >= 0) {
+      ::close(source.fd);
+    }
+    if (source.kind == SourceKind::Listener) {
+      ::unlink(source.path.c_str());
+    }
+    source.fd = -1;
+  }
+
+  // Raises a pipe's kernel buffer so bursts are absorbed in fewer, larger
+  // reads. Best effort: the limit is capped by /proc/sys/fs/pipe-max-size.
+  void growPipe(int fd) {
+#ifdef F_SETPIPE_SZ
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode)) {
+      (void)fcntl(fd, F_SETPIPE_SZ, static_cast<int>(kMaxReadSize));
+    }
+#else
+    (void)fd;
+#endif
+  }
 
-    writer_.appendLine(currentLine_);
+  // Sizes the next read() to the backlog reported by FIONREAD, so a burst is
+  // drained in one syscall. The buffer is shared by every source and only
+  // grows, up to kMaxReadSize.
+  size_t nextReadSize(int fd) {
+    int pending = 0;
+    if (ioctl(fd, FIONREAD, &pending) == 0 &&
+        static_cast<size_t>(pending) > buffer_.size()) {
+      size_t size = buffer_.size();
+      while (size < static_cast<size_t>(pending) && size < kMaxReadSize) {
+        size *= 2;
+      }
+      buffer_.resize(size);
+    }
+    return buffer_.size();
   }
 
-  Writer &writer_;
   size_t maxSize_;
-  std::string currentLine_;
-  bool droppingLine_ = false;
+  std::vector<std::unique_ptr<Source>> sources_;
+  std::vector<char> buffer_ = std::vector<char>(kMinReadSize);
+  std::chrono::steady_clock::time_point nextTailScan_{};
+  size_t tailCount_ = 0;
+  StatsReporter *stats_ = nullptr;
+#if EPOLL_AVAILABLE
+  int epollFd_ = -1;
+  int stdinFlags_ = -1;          // Original stdin flags, before O_NONBLOCK
+  std::vector<Source *> ready_; // Sources not yet drained to EAGAIN
+#endif
   bool shuttingDown_ = false;
 };
 
@@ -610,34 +5813,47 @@ void fallbackSignalHandler(int) { g_running = 0; }
 
 class FallbackInputReader {
 public:
-  FallbackInputReader(Writer &writer, size_t maxSize)
-      : writer_(writer), maxSize_(maxSize) {}
+  FallbackInputReader(Writer &writer, size_t maxSize, size_t parseThreads)
+      : splitter_(writer, maxSize, parseThreads), buffer_(kBufferSize) {}
 
+  // Pulls whatever the stream buffer already holds (blocking only when it is
+  // empty) and frames it with the same LineSplitter as the POSIX reader, so
+  // lines go from the stream buffer into the writer's queue without ever
+  // being copied into a std::string.
   bool readLoop() {
     std::signal(SIGINT, fallbackSignalHandler);
     std::signal(SIGTERM, fallbackSignalHandler);
 
-    std::string line;
-    while (g_running && std::getline(std::cin, line)) {
-      // CRLF normalization
-      if (!line.empty() && line.back() == '\r') {
-        line.pop_back();
+    std::streambuf *in = std::cin.rdbuf();
+    while (g_running) {
+      size_t n = 0;
+      std::streamsize avail = in->in_avail();
+      if (avail <= 0) {
+        int c = in->sbumpc(); // Blocks until input arrives or EOF
+        if (c == std::char_traits<char>::eof()) {
+          break;
+        }
+        buffer_[n++] = static_cast<char>(c);
+        avail = in->in_avail();
       }
-
-      // Drop overlong lines
-      if (line.size() + 1 > maxSize_) {
-        continue;
+      if (avail > 0) {
+        n += static_cast<size_t>(in->sgetn(
+            buffer_.data() + n,
+            std::min<std::streamsize>(
+                avail, static_cast<std::streamsize>(buffer_.size() - n))));
       }
-
-      writer_.appendLine(line);
+      splitter_.consume(buffer_.data(), n);
     }
+    splitter_.finish();
 
     return true;
   }
 
 private:
-  Writer &writer_;
-  size_t maxSize_;
+  static constexpr size_t kBufferSize = 64 * 1024;
+
+  LineSplitter splitter_;
+  std::vector<char> buffer_;
 };
 
 #endif // !POSIX_AVAILABLE
@@ -646,12 +5862,18 @@ private:
 // Main
 // ============================================================================
 
+// bench.cc includes this file with LOGWINDOW_NO_MAIN to reach the internals
+#ifndef LOGWINDOW_NO_MAIN
+
 int main(int argc, char *argv[]) {
   // Iostream performance tuning
   std::ios::sync_with_stdio(false);
   std::cin.tie(nullptr);
 
   Config config = parseArgs(argc, argv);
+  if (config.decompress) {
+    return decompressWindow(config.logFile);
+  }
 
   // Warn if atomic writes requested on non-POSIX
 #if !POSIX_AVAILABLE
@@ -659,35 +5881,119 @@ int main(int argc, char *argv[]) {
     std::cerr << "Warning: --atomic-writes may not be fully atomic on this "
                  "platform\n";
   }
+  if (config.ioUring) {
+    std::cerr << "Warning: --io-uring is not supported on this platform\n";
+  }
+  if (config.mmapWindow) {
+    std::cerr << "Warning: --mmap is not supported on this platform; "
+                 "using in-place writes\n";
+  }
+  if (config.incremental) {
+    std::cerr << "Warning: --incremental is not supported on this platform; "
+                 "rewriting the whole file on each flush\n";
+  }
+  if (config.inputs.size() > 1 || config.inputs.front().source != "-") {
+    std::cerr << "Error: --input is not supported on this platform\n";
+    return 1;
+  }
+  if (!config.serve.empty()) {
+    std::cerr << "Error: --serve is not supported on this platform\n";
+    return 1;
+  }
+  if (config.notify) {
+    std::cerr << "Warning: --notify is not supported on this platform\n";
+  }
+  if (config.durability != Durability::None) {
+    std::cerr << "Warning: --durability is not supported on this platform\n";
+  }
 #endif
 
-  Writer writer(config);
-
-  // Start writer thread
-  std::thread writerThread([&writer]() { writer.writerThread(); });
-
 #if POSIX_AVAILABLE
-  // POSIX: Setup signal handling and poll-based input
+  // POSIX: Setup signal handling (before any thread starts) and event-driven
+  // input
   if (!setupSignalHandling()) {
     std::cerr << "Failed to setup signal handling, exiting\n";
-    writer.shutdown();
-    writerThread.join();
     return 1;
   }
+#endif
+
+#if POSIX_AVAILABLE
+  // Outlives the pool, whose writers publish to it until they finish
+  WindowServer server(config.maxSize);
+  if (!config.serve.empty() && !server.listen(config.serve)) {
+    cleanupSignalHandling();
+    return 1;
+  }
+#endif
+
+#if POSIX_AVAILABLE
+  // Outlives the pool too: writers release their files to it on close
+  SyncScheduler syncer(config.durability, config.syncInterval);
+  syncer.start();
+#endif
+
+  // One writer (window and output file) per input, serviced by a small
+  // shared pool of threads
+  MemoryBudget budget(config.memoryBudget, config.minWindow, config.maxSize);
+  WriterPool pool(std::min(config.writerThreads, config.inputs.size()));
+  std::vector<Writer *> writers;
+  for (const InputSpec &input : config.inputs) {
+    Config stream = config;
+    stream.logFile = input.logFile;
+    writers.push_back(&pool.add(stream));
+    if (budget.active()) {
+      writers.back()->shareBudget(budget);
+    }
+  }
+#if POSIX_AVAILABLE
+  if (!config.serve.empty()) {
+    writers.front()->serve(server);
+  }
+  if (syncer.active()) {
+    for (Writer *writer : writers) {
+      writer->syncWith(syncer);
+    }
+  }
+#endif
+  pool.start();
+
+  StatsReporter fileStats(writers);
+  if (!config.statsFile.empty()) {
+    fileStats.start(config.statsFile, config.statsInterval);
+  }
 
-  PosixInputReader reader(writer, config.maxSize);
+#if POSIX_AVAILABLE
+  StatsReporter signalStats(writers);
+  PosixInputReader reader(config.maxSize);
+  reader.setStatsReporter(&signalStats);
+  for (size_t i = 0; i < config.inputs.size(); ++i) {
+    if (config.inputs[i].source == "-") {
+      reader.addStdin(*writers[i], config.parseThreads);
+    } else if (!reader.addInput(config.inputs[i].source, *writers[i])) {
+      cleanupSignalHandling();
+      pool.shutdown();
+      return 1;
+    }
+  }
   reader.readLoop();
 
   cleanupSignalHandling();
 #else
   // Non-POSIX: Use simple getline-based reader
-  FallbackInputReader reader(writer, config.maxSize);
+  FallbackInputReader reader(*writers.front(), config.maxSize,
+                             config.parseThreads);
   reader.readLoop();
 #endif
 
-  // Shutdown writer thread
-  writer.shutdown();
-  writerThread.join();
+  // Flush every window and stop the writer threads
+  pool.shutdown();
+  fileStats.stop(); // Final snapshot covers the last flushes
+#if POSIX_AVAILABLE
+  server.stop(); // After the writers published their last lines
+  syncer.stop(); // Last round covers the final flushes
+#endif
 
   return 0;
 }
+
+#endif // LOGWINDOW_NO_MAIN
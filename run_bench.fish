@@ -0,0 +1,23 @@
+#!/usr/bin/env fish
+
+# Benchmark runner for logwindow
+#
+# Usage: ./run_bench.fish [filter]
+#   filter: only run benchmarks whose name contains this substring
+
+set -g normal (set_color normal)
+set -g red (set_color red)
+set -g yellow (set_color yellow)
+
+set -g BENCH_BINARY "./logwindow_bench"
+
+echo "Compiling benchmarks..."
+clang++ -std=c++20 -O3 -Wall -Wextra -pedantic -o $BENCH_BINARY bench.cc
+if not test $status -eq 0
+    echo "{$red}[ERROR]{$normal} Compilation failed. Aborting benchmarks."
+    exit 1
+end
+
+echo "{$yellow}--- Running benchmarks ---{$normal}"
+$BENCH_BINARY $argv
+exit $status
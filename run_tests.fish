@@ -309,6 +309,605 @@ function test_atomic_writes
     end
 end
 
+function test_incremental_mode
+    set -l test_name "Incremental mode"
+    set -l log_file "$TEST_DIR/incremental.log"
+
+    # 12 lines (87 bytes) fit the window; 3 more (24 bytes) overflow it
+    set -l writer_script "$TEST_DIR/writer_incremental.sh"
+    echo "#!/bin/bash" > $writer_script
+    echo 'for i in $(seq 1 12); do echo "line $i"; done' >> $writer_script
+    echo "sleep 0.2" >> $writer_script
+    echo 'for i in $(seq 13 15); do echo "line $i"; done' >> $writer_script
+    echo "sleep 0.4" >> $writer_script
+    chmod +x $writer_script
+
+    $writer_script | $BINARY $log_file --max-size 100 --incremental --write-interval 100 &
+    set -l lw_pid $last_pid
+
+    sleep 0.45
+
+    # New lines are appended, so the file temporarily exceeds max-size
+    set -l size_live (stat -f%z $log_file 2>/dev/null; or stat -c%s $log_file 2>/dev/null; or echo 0)
+    if test $size_live -eq 111
+        pass_test "$test_name: new lines appended without rewriting"
+    else
+        fail_test "$test_name: expected 111 bytes while running, got $size_live"
+    end
+
+    wait $lw_pid 2>/dev/null
+
+    # The final flush compacts the file down to the window
+    set -l content (cat $log_file 2>/dev/null | string collect)
+    set -l expected (seq 3 15 | string replace -r '^' 'line ' | string collect)
+    if test "$content" = "$expected"
+        pass_test "$test_name: final flush compacts to the window"
+    else
+        fail_test "$test_name: content mismatch after final compaction"
+        printf "Expected length: %d\n" (string length -- "$expected")
+        printf "Actual length:   %d\n" (string length -- "$content")
+    end
+end
+
+function test_collapse_trim
+    set -l test_name "Collapse trim strategy"
+    set -l log_file "$TEST_DIR/collapse.log"
+
+    # Feed 30 paced batches so the file is appended to and trimmed repeatedly
+    set -l input_script "$TEST_DIR/input_collapse.py"
+    echo "import sys, time" > $input_script
+    echo "for b in range(30):" >> $input_script
+    echo "    sys.stdout.write(''.join('b%03d l%03d %s\\n' % (b, i, 'y' * 50) for i in range(30)))" >> $input_script
+    echo "    sys.stdout.flush()" >> $input_script
+    echo "    time.sleep(0.03)" >> $input_script
+
+    python3 $input_script | $BINARY $log_file --max-size 8192 --compact-size 12000 --trim-strategy collapse --write-interval 20 >/dev/null 2>&1
+
+    # Collapsing trims on block boundaries while running, but the final flush
+    # rewrites the file to exactly the window
+    set -l check_script "$TEST_DIR/check_collapse.py"
+    echo "import sys" > $check_script
+    echo "lines = ['b%03d l%03d %s\\n' % (b, i, 'y' * 50) for b in range(30) for i in range(30)]" >> $check_script
+    echo "window = ''.join(lines[-(8192 // len(lines[0])):])" >> $check_script
+    echo "sys.exit(0 if open(sys.argv[1]).read() == window else 1)" >> $check_script
+
+    if python3 $check_script $log_file
+        pass_test "$test_name: exactly the window remains after exit"
+    else
+        fail_test "$test_name: file is not exactly the window"
+    end
+end
+
+function test_mmap_mode
+    set -l test_name "Mmap mode"
+    set -l log_file "$TEST_DIR/mmap.log"
+
+    set -l writer_script "$TEST_DIR/writer_mmap.sh"
+    echo "#!/bin/bash" > $writer_script
+    echo 'for i in $(seq 1 40); do echo "line $i"; done' >> $writer_script
+    echo "sleep 0.4" >> $writer_script
+    chmod +x $writer_script
+
+    $writer_script | $BINARY $log_file --max-size 100 --mmap --write-interval 100 &
+    set -l lw_pid $last_pid
+
+    sleep 0.2
+
+    # While running, the file is a fixed-size ring described by the sidecar
+    set -l size_live (stat -f%z $log_file 2>/dev/null; or stat -c%s $log_file 2>/dev/null; or echo 0)
+    if test $size_live -eq 100; and test -f "$log_file.head"
+        pass_test "$test_name: file is mapped at a fixed size with a .head sidecar"
+    else
+        fail_test "$test_name: expected a 100 byte ring and a .head sidecar (size $size_live)"
+    end
+
+    wait $lw_pid 2>/dev/null
+
+    # On exit the ring is rewritten as the plain-text window
+    set -l content (cat $log_file 2>/dev/null | string collect)
+    set -l expected (seq 29 40 | string replace -r '^' 'line ' | string collect)
+    if test "$content" = "$expected"
+        pass_test "$test_name: file holds the plain-text window after exit"
+    else
+        fail_test "$test_name: content mismatch after exit"
+        printf "Expected length: %d\n" (string length -- "$expected")
+        printf "Actual length:   %d\n" (string length -- "$content")
+    end
+end
+
+function test_pipe_burst
+    set -l test_name "Pipe burst"
+    set -l log_file "$TEST_DIR/burst.log"
+
+    # A fast producer that exits right away leaves data queued behind POLLHUP;
+    # all of it must still be read before shutting down.
+    python3 -c "import sys; sys.stdout.write(''.join('line %d\\n' % i for i in range(200000)))" | $BINARY $log_file --max-size 100 >/dev/null 2>&1
+
+    set -l content (cat $log_file 2>/dev/null | string collect)
+    set -l expected (seq 199992 199999 | string replace -r '^' 'line ' | string collect)
+    if test "$content" = "$expected"
+        pass_test "$test_name: the last lines of a burst are kept"
+    else
+        fail_test "$test_name: input after POLLHUP was lost"
+        printf "Expected length: %d\n" (string length -- "$expected")
+        printf "Actual length:   %d\n" (string length -- "$content")
+    end
+end
+
+function test_io_uring
+    set -l test_name "io_uring writes"
+    set -l log_file "$TEST_DIR/uring.log"
+
+    # Falls back to synchronous writes where io_uring is unavailable
+    printf "line 1\nline 2\nline 3\n" | $BINARY $log_file --max-size 15 --io-uring --immediate >/dev/null 2>&1
+
+    set -l content (cat $log_file 2>/dev/null | string collect)
+    set -l expected (printf "line 2\nline 3\n" | string collect)
+    if test "$content" = "$expected"
+        pass_test "$test_name: window written and truncated correctly"
+    else
+        fail_test "$test_name: content mismatch"
+        printf "Expected length: %d\n" (string length -- "$expected")
+        printf "Actual length:   %d\n" (string length -- "$content")
+    end
+end
+
+function test_multi_input
+    set -l test_name "Multi-input fan-in"
+    set -l fifo_log "$TEST_DIR/fanin_fifo.log"
+    set -l tail_log "$TEST_DIR/fanin_tail.log"
+    set -l fifo "$TEST_DIR/fanin.fifo"
+    set -l tailed "$TEST_DIR/fanin_source.log"
+
+    # One process windows a FIFO (created on startup) and a tailed file
+    printf "old line\n" > $tailed
+    $BINARY --input $fifo_log=$fifo --input $tail_log=$tailed --max-size 100 --immediate >/dev/null 2>&1 &
+    set -l pid $last_pid
+    sleep 0.3
+
+    printf "fifo 1\nfifo 2\n" > $fifo
+    printf "tail 1\n" >> $tailed
+    sleep 0.6
+    kill -INT $pid
+    wait $pid
+
+    set -l fifo_content (cat $fifo_log 2>/dev/null | string collect)
+    set -l tail_content (cat $tail_log 2>/dev/null | string collect)
+    if test "$fifo_content" = (printf "fifo 1\nfifo 2\n" | string collect)
+        pass_test "$test_name: FIFO lines reached their own window"
+    else
+        fail_test "$test_name: FIFO window mismatch"
+        printf "Actual: %s\n" "$fifo_content"
+    end
+    if test "$tail_content" = (printf "tail 1\n" | string collect)
+        pass_test "$test_name: tailed file followed from its end"
+    else
+        fail_test "$test_name: tail window mismatch"
+        printf "Actual: %s\n" "$tail_content"
+    end
+end
+
+function test_stdin_redirect
+    set -l test_name "Stdin from a file"
+    set -l log_file "$TEST_DIR/redirect.log"
+    set -l input_file "$TEST_DIR/redirect_input.txt"
+
+    # A regular file can't be registered with epoll; it must still be read to EOF
+    printf "line 1\nline 2\nline 3\n" > $input_file
+    $BINARY $log_file --max-size 15 < $input_file >/dev/null 2>&1
+
+    set -l content (cat $log_file 2>/dev/null | string collect)
+    set -l expected (printf "line 2\nline 3\n" | string collect)
+    if test "$content" = "$expected"
+        pass_test "$test_name: redirected file read to EOF"
+    else
+        fail_test "$test_name: content mismatch"
+        printf "Expected length: %d\n" (string length -- "$expected")
+        printf "Actual length:   %d\n" (string length -- "$content")
+    end
+end
+
+function test_flush_policy
+    set -l test_name "Flush policy"
+    set -l idle_log "$TEST_DIR/idle.log"
+    set -l bytes_log "$TEST_DIR/bytes.log"
+
+    # Idle debounce: nothing while lines keep coming, a flush once they stop
+    begin
+        for i in 1 2 3
+            echo "line $i"
+            sleep 0.05
+        end
+        sleep 0.5
+    end | $BINARY $idle_log --flush-idle 200 --write-interval 5000 &
+    sleep 0.18
+    set -l early (cat $idle_log 2>/dev/null | string collect)
+    sleep 0.3
+    set -l late (cat $idle_log 2>/dev/null | string collect)
+    wait
+
+    if test -z "$early" -a "$late" = (printf "line 1\nline 2\nline 3\n" | string collect)
+        pass_test "$test_name: flushed once the input went quiet"
+    else
+        fail_test "$test_name: idle flush timing wrong"
+    end
+
+    # Byte trigger: a large enough batch is flushed long before the interval
+    begin
+        printf "short\n"
+        sleep 0.2
+        printf "%s\n" (string repeat -n 50 x)
+        sleep 0.5
+    end | $BINARY $bytes_log --flush-bytes 40 --write-interval 5000 &
+    sleep 0.1
+    set -l before (cat $bytes_log 2>/dev/null | string collect)
+    sleep 0.25
+    set -l after (cat $bytes_log 2>/dev/null | string collect)
+    wait
+
+    if test -z "$before" -a (string length -- "$after") -eq 56
+        pass_test "$test_name: flushed after --flush-bytes of input"
+    else
+        fail_test "$test_name: byte-triggered flush missing"
+    end
+end
+
+function test_stats_file
+    set -l test_name "Stats file"
+    set -l log_file "$TEST_DIR/stats.log"
+    set -l stats_file "$TEST_DIR/stats.json"
+
+    # The final snapshot is written on exit and counts every line
+    printf "line 1\nline 2\n%s\nline 3\n" (string repeat -n 40 x) | $BINARY $log_file --max-size 15 --stats-file $stats_file >/dev/null 2>&1
+
+    set -l counts (python3 -c "import json,sys; s=json.load(open(sys.argv[1]))['streams'][0]; print(s['lines_in'], s['lines_dropped'], s['lines_evicted'], s['flushes'])" $stats_file 2>/dev/null)
+    if test "$counts" = "3 1 1 1"
+        pass_test "$test_name: lines in, dropped, evicted and flushes counted"
+    else
+        fail_test "$test_name: unexpected counters: $counts"
+    end
+end
+
+function test_compressed_window
+    set -l test_name "Compressed window"
+    set -l log_file "$TEST_DIR/chunked.log"
+
+    set -l input (seq 1 2000 | string replace -r '^' 'line ' | string collect)
+    set -l errors (printf "%s\n" $input | $BINARY $log_file --max-size 5000 --chunk-size 1000 --compress zstd 2>&1)
+    if string match -q "*no zstd support*" -- "$errors"
+        pass_test "$test_name: skipped (built without -DLOGWINDOW_WITH_ZSTD)"
+        return
+    end
+
+    # The window is rebuilt from whole sealed chunks plus the open chunk, so
+    # it ends with the newest lines and keeps between 5000 and 6000 bytes
+    set -l content ($BINARY $log_file --decompress | string collect)
+    set -l bytes (string length -- "$content")
+    set -l expected_tail (seq 1991 2000 | string replace -r '^' 'line ' | string collect)
+    if string match -q -- "*$expected_tail" "$content"; and test $bytes -ge 4999 -a $bytes -le 6000
+        pass_test "$test_name: --decompress returns the window"
+    else
+        fail_test "$test_name: decompressed window mismatch ($bytes bytes)"
+    end
+end
+
+function test_line_index
+    set -l test_name "Line index"
+    set -l log_file "$TEST_DIR/indexed.log"
+
+    seq 1 100 | $BINARY $log_file --max-size 50 --index-timestamps
+
+    # Index lists every line start in the file, plus one arrival time each
+    set -l result (python3 -c "
+import struct, sys
+log = open(sys.argv[1], 'rb').read()
+idx = open(sys.argv[1] + '.idx', 'rb').read()
+count, flags, size = struct.unpack_from('<QQQ', idx, 8)
+offsets = struct.unpack_from('<%dQ' % count, idx, 32)
+times = struct.unpack_from('<%dq' % count, idx, 32 + 8 * count)
+starts = [0] + [i + 1 for i, c in enumerate(log[:-1]) if c == 10]
+print(idx[:8] == b'LOGIDX1\\0' and size == len(log) and list(offsets) == starts and flags == 1 and min(times) > 0)
+" $log_file 2>&1)
+    if test "$result" = "True"
+        pass_test "$test_name: offsets and timestamps match the window"
+    else
+        fail_test "$test_name: index does not match $log_file ($result)"
+    end
+end
+
+function test_serve_window
+    set -l test_name "Live window socket"
+    set -l log_file "$TEST_DIR/served.log"
+    set -l fifo "$TEST_DIR/served.fifo"
+    set -l sock "$TEST_DIR/served.sock"
+
+    # A client gets the current window on connect, then each new line
+    $BINARY --input $log_file=$fifo --serve unix:$sock --max-size 15 >/dev/null 2>&1 &
+    set -l pid $last_pid
+    sleep 0.3
+    printf "line 1\nline 2\nline 3\n" > $fifo
+    sleep 0.3
+
+    set -l out "$TEST_DIR/served.out"
+    python3 -c "
+import socket, sys, time
+s = socket.socket(socket.AF_UNIX)
+s.connect(sys.argv[1])
+s.settimeout(0.2)
+data = b''
+end = time.time() + 1.0
+while time.time() < end:
+    try:
+        data += s.recv(4096)
+    except socket.timeout:
+        pass
+sys.stdout.write(data.decode())
+" $sock > $out &
+    set -l client $last_pid
+    sleep 0.4
+    printf "line 4\n" > $fifo
+    wait $client
+    kill -INT $pid
+    wait $pid
+
+    set -l content (cat $out 2>/dev/null | string collect)
+    if test "$content" = (printf "line 2\nline 3\nline 4\n" | string collect)
+        pass_test "$test_name: snapshot followed by new lines"
+    else
+        fail_test "$test_name: client stream mismatch"
+        printf "Actual: %s\n" "$content"
+    end
+    if not test -e $sock
+        pass_test "$test_name: socket removed on exit"
+    else
+        fail_test "$test_name: socket left behind"
+    end
+
+    # Clients get the raw input, so options that rewrite the window are refused
+    for opt in --collapse-repeats "--max-tokens 100"
+        echo line | $BINARY $log_file --serve unix:$sock (string split " " $opt) >/dev/null 2>&1
+        if test $status -ne 0
+            pass_test "$test_name: rejected with $opt"
+        else
+            fail_test "$test_name: accepted $opt"
+        end
+    end
+end
+
+function test_change_notification
+    set -l test_name "Change notification"
+    set -l log_file "$TEST_DIR/notified.log"
+
+    printf "line 1\nline 2\nline 3\n" | $BINARY $log_file --max-size 15 --notify
+
+    # 21 bytes arrived; the window is the last 14 and the file holds just it
+    set -l header (python3 -c "
+import struct, sys
+d = open(sys.argv[1] + '.gen', 'rb').read()
+gen, = struct.unpack_from('<I', d, 8)
+seq, start, begin, end, changed = struct.unpack_from('<5Q', d, 16)
+print(d[:8] == b'LOGGEN1\\0', gen, seq % 2, start, begin, end)
+" $log_file 2>&1)
+    if test "$header" = "True 1 0 7 7 21"
+        pass_test "$test_name: generation and window range published"
+    else
+        fail_test "$test_name: unexpected header: $header"
+    end
+end
+
+function test_line_filters
+    set -l test_name "Line filters"
+    set -l log_file "$TEST_DIR/filtered.log"
+
+    # Health checks and HMR updates never enter the window
+    printf "GET /health 200\nreal 1\n[HMR] update\nreal 2\nGET /health 200\n" | $BINARY $log_file --exclude /health --exclude-regex '^\[HMR\]'
+    set -l content (cat $log_file 2>/dev/null | string collect)
+    if test "$content" = (printf "real 1\nreal 2\n" | string collect)
+        pass_test "$test_name: excluded lines dropped"
+    else
+        fail_test "$test_name: exclude mismatch"
+        printf "Actual: %s\n" "$content"
+    end
+
+    # 1-in-N sampling keeps the first matching line of every N
+    seq 1 30 | string replace -r '^' 'tick ' | $BINARY $log_file --sample 10:tick
+    set -l content (cat $log_file 2>/dev/null | string collect)
+    if test "$content" = (printf "tick 1\ntick 11\ntick 21\n" | string collect)
+        pass_test "$test_name: sampling keeps 1 in N"
+    else
+        fail_test "$test_name: sampling mismatch"
+        printf "Actual: %s\n" "$content"
+    end
+end
+
+function test_collapse_repeats
+    set -l test_name "Collapse repeats"
+    set -l log_file "$TEST_DIR/repeats.log"
+
+    printf "start\nretry\nretry\nretry\nre\nend\n" | $BINARY $log_file --collapse-repeats
+    set -l content (cat $log_file 2>/dev/null | string collect)
+    set -l expected (printf "start\nretry (repeated 3 times)\nre\nend\n" | string collect)
+    if test "$content" = "$expected"
+        pass_test "$test_name: consecutive repeats stored once with a counter"
+    else
+        fail_test "$test_name: content mismatch"
+        printf "Expected: %s\nActual: %s\n" "$expected" "$content"
+    end
+end
+
+function test_parse_threads
+    set -l test_name "Parallel parsing"
+    set -l serial_log "$TEST_DIR/serial.log"
+    set -l parallel_log "$TEST_DIR/parallel.log"
+    set -l input_file "$TEST_DIR/parallel_input.txt"
+
+    # CRLF, overlong, filtered and sampled lines plus an unterminated tail
+    python3 -c "
+import sys
+out = []
+for i in range(50000):
+    out.append(['line %d' % i, 'crlf %d\\r' % i, 'x' * 300, 'GET /health', 'tick %d' % i][i % 5])
+sys.stdout.write('\\n'.join(out) + '\\ntail')
+" > $input_file
+    set -l options --max-size 200 --exclude /health --sample 3:tick
+    $BINARY $parallel_log $options --parse-threads 4 < $input_file
+    $BINARY $serial_log $options < $input_file
+
+    if cmp -s $serial_log $parallel_log
+        pass_test "$test_name: same window as the single-threaded reader"
+    else
+        fail_test "$test_name: windows differ"
+    end
+end
+
+function test_timestamps
+    set -l test_name "Timestamps"
+    set -l log_file "$TEST_DIR/timestamps.log"
+
+    printf "first\r\nsecond\n" | $BINARY $log_file --timestamps
+    set -l lines (cat $log_file 2>/dev/null)
+    set -l year (date -u +%Y)
+    if test (count $lines) -eq 2
+        and string match -qr "^$year-\d\d-\d\dT\d\d:\d\d:\d\d\.\d{3}Z first\$" -- $lines[1]
+        and string match -qr "^$year-\d\d-\d\dT\d\d:\d\d:\d\d\.\d{3}Z second\$" -- $lines[2]
+        pass_test "$test_name: each line prefixed with its UTC arrival time"
+    else
+        fail_test "$test_name: unexpected content"
+        printf "Actual: %s\n" $lines
+    end
+end
+
+function test_resume
+    set -l test_name "Resume"
+    set -l log_file "$TEST_DIR/resume.log"
+
+    seq 1 10 | $BINARY $log_file --max-size 20
+    printf "11\n12\n" | $BINARY $log_file --max-size 20 --resume
+    set -l content (cat $log_file 2>/dev/null | string collect)
+    set -l expected (printf "5\n6\n7\n8\n9\n10\n11\n12\n" | string collect)
+    if test "$content" = "$expected"
+        pass_test "$test_name: restart continues the previous window"
+    else
+        fail_test "$test_name: content mismatch"
+        printf "Expected: %s\nActual: %s\n" "$expected" "$content"
+    end
+end
+
+function test_durability
+    set -l test_name "Durability"
+    set -l log_file "$TEST_DIR/durable.log"
+
+    printf "line 1\nline 2\n" | $BINARY $log_file --durability always --atomic-writes
+    set -l content (cat $log_file 2>/dev/null | string collect)
+    set -l expected (printf "line 1\nline 2\n" | string collect)
+    if test "$content" = "$expected"; and not test -e "$log_file.tmp"
+        pass_test "$test_name: synced atomic flushes leave only the log file"
+    else
+        fail_test "$test_name: content mismatch or leftover temp file"
+    end
+
+    if printf "x\n" | $BINARY $log_file --durability sometimes 2>/dev/null
+        fail_test "$test_name: invalid mode accepted"
+    else
+        pass_test "$test_name: invalid mode rejected"
+    end
+end
+
+function test_memory_budget
+    set -l test_name "Memory budget"
+    set -l log_file "$TEST_DIR/budget.log"
+
+    seq 1 1000 | $BINARY $log_file --memory-budget 100
+    set -l size (stat -f%z $log_file 2>/dev/null; or stat -c%s $log_file 2>/dev/null; or echo 0)
+    set -l last (tail -n 1 $log_file)
+    if test $size -le 100; and test "$last" = "1000"
+        pass_test "$test_name: window held within the budget"
+    else
+        fail_test "$test_name: size $size, last line $last"
+    end
+
+    if $BINARY $log_file --min-window 10 </dev/null 2>/dev/null
+        fail_test "$test_name: --min-window accepted without a budget"
+    else
+        pass_test "$test_name: --min-window needs --memory-budget"
+    end
+
+    # Two equally busy streams share the whole budget once rebalanced
+    set -l log_a "$TEST_DIR/budget_a.log"
+    set -l log_b "$TEST_DIR/budget_b.log"
+    $BINARY --input $log_a=$TEST_DIR/budget_a.fifo --input $log_b=$TEST_DIR/budget_b.fifo --memory-budget 20k >/dev/null 2>&1 &
+    set -l pid $last_pid
+    sleep 0.3
+    seq 1 6000 > $TEST_DIR/budget_a.fifo &
+    seq 1 6000 > $TEST_DIR/budget_b.fifo
+    sleep 1.5
+    kill -INT $pid
+    wait $pid
+    set -l size_a (stat -f%z $log_a 2>/dev/null; or stat -c%s $log_a 2>/dev/null; or echo 0)
+    set -l size_b (stat -f%z $log_b 2>/dev/null; or stat -c%s $log_b 2>/dev/null; or echo 0)
+    set -l total (math $size_a + $size_b)
+    if test $total -ge 19000; and test $total -le 20000
+        pass_test "$test_name: windows add up to the budget"
+    else
+        fail_test "$test_name: windows hold $total of 20000 bytes"
+    end
+end
+
+function test_history
+    set -l test_name "History"
+    set -l log_file "$TEST_DIR/history.log"
+
+    seq 1 1000 | $BINARY $log_file --max-size 100 --history 1000 --history-segment 300
+    set -l segments $log_file.history/*.log
+    set -l content (cat $segments $log_file 2>/dev/null | string collect)
+    set -l lines (count (string split \n -- $content))
+    set -l expected (seq 1 1000 | tail -n $lines | string collect)
+    if test (count $segments) -ge 3; and test $lines -gt 100; and test "$content" = "$expected"
+        pass_test "$test_name: segments continue seamlessly into the window"
+    else
+        fail_test "$test_name: "(count $segments)" segments, $lines lines"
+    end
+
+    set -l total 0
+    set -l oversized 0
+    for segment in $segments
+        set -l size (stat -f%z $segment 2>/dev/null; or stat -c%s $segment 2>/dev/null; or echo 0)
+        set total (math $total + $size)
+        if test $size -gt 300
+            set oversized 1
+        end
+    end
+    if test $total -le 1000; and test $oversized -eq 0
+        pass_test "$test_name: segments rotated and old ones deleted"
+    else
+        fail_test "$test_name: $total bytes of history"
+    end
+end
+
+function test_max_tokens
+    set -l test_name "Max tokens"
+    set -l log_file "$TEST_DIR/tokens.log"
+
+    # A short word or two-digit number plus the newline: 2 tokens
+    printf "alpha\nbeta\n42\ngamma\ndelta\n" | $BINARY $log_file --max-tokens 6
+    set -l content (cat $log_file 2>/dev/null | string collect)
+    set -l expected (printf "42\ngamma\ndelta\n" | string collect)
+    if test "$content" = "$expected"
+        pass_test "$test_name: window trimmed to the token budget"
+    else
+        fail_test "$test_name: content mismatch"
+        printf "Expected: %s\nActual: %s\n" "$expected" "$content"
+    end
+
+    printf "a b c d e f g h\nok\n" | $BINARY $log_file --max-tokens 4
+    set content (cat $log_file 2>/dev/null | string collect)
+    if test "$content" = "ok"
+        pass_test "$test_name: line over the budget dropped"
+    else
+        fail_test "$test_name: got $content"
+    end
+end
+
 # --- Run tests ---
 run_test "Basic Truncation" test_basic_truncation
 run_test "Immediate Mode" test_immediate_mode
@@ -317,6 +916,28 @@ run_test "Signal Termination" test_signal_termination
 run_test "Overlong Lines" test_overlong_lines
 run_test "CRLF Normalization" test_crlf_normalization
 run_test "Atomic Writes" test_atomic_writes
+run_test "Incremental Mode" test_incremental_mode
+run_test "Collapse Trim" test_collapse_trim
+run_test "Mmap Mode" test_mmap_mode
+run_test "Pipe Burst" test_pipe_burst
+run_test "io_uring" test_io_uring
+run_test "Multi-input" test_multi_input
+run_test "Stdin Redirect" test_stdin_redirect
+run_test "Flush Policy" test_flush_policy
+run_test "Stats File" test_stats_file
+run_test "Compressed Window" test_compressed_window
+run_test "Line Index" test_line_index
+run_test "Live Window Socket" test_serve_window
+run_test "Change Notification" test_change_notification
+run_test "Line Filters" test_line_filters
+run_test "Collapse Repeats" test_collapse_repeats
+run_test "Parallel Parsing" test_parse_threads
+run_test "Timestamps" test_timestamps
+run_test "Resume" test_resume
+run_test "Durability" test_durability
+run_test "Memory Budget" test_memory_budget
+run_test "History" test_history
+run_test "Max Tokens" test_max_tokens
 
 # --- Summary ---
 echo ""